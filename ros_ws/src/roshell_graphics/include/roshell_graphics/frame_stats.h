@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace roshell_graphics
+{
+
+typedef std::chrono::steady_clock StatsClock;
+
+/**
+ * Stages a frame goes through, from the message to the terminal
+*/
+enum FrameStage
+{
+    FRAME_STAGE_INGEST = 0,     // Deserializing and converting the message, timed by the node
+    FRAME_STAGE_PROJECT,        // Projecting points to the natural frame
+    FRAME_STAGE_RASTERIZE,      // Filling the cells with points, lines, images and text
+    FRAME_STAGE_ENCODE,         // Turning the cells into escape sequences
+    FRAME_STAGE_WRITE,          // Writing the frame to the output sink
+    FRAME_STAGE_COUNT
+};
+
+/**
+ * Histogram of non-negative integers, e.g. durations in nanoseconds. Values
+ * below 16 get a bucket each, above that each power of two is split into 8
+ * buckets, so percentiles are within 12.5%. Recording is lock-free and safe
+ * from any number of threads, reading while recording gives a snapshot that
+ * may miss the latest values.
+*/
+class Histogram
+{
+public:
+    Histogram();
+
+    void record(const uint64_t& value);
+    void reset();
+
+    uint64_t get_count() const;
+    uint64_t get_max() const;
+    double get_mean() const;
+    // Upper bound of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t get_percentile(const double& p) const;
+
+    static constexpr int NUM_BUCKETS = 16 + 60 * 8;
+
+    // Bucket value falls in, and the largest value that falls in bucket
+    static int get_bucket(const uint64_t& value);
+    static uint64_t get_bucket_upper_bound(const int& bucket);
+
+private:
+    std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+/**
+ * Time spent in each FrameStage and bytes written per frame.
+ *
+ * Stage times go to one histogram per stage, and the last value of each is
+ * kept for the overlay. Optionally, the stages are also kept as spans in a
+ * ring buffer that is dumped in the Chrome trace format (chrome://tracing or
+ * Perfetto). Everything is lock-free, so the render thread, the writer thread
+ * and the ROS callbacks can all record while another thread reads.
+*/
+class FrameStats
+{
+public:
+    FrameStats();
+
+    // Stats are only collected while enabled, off by default
+    void set_enabled(const bool& enabled);
+    bool is_enabled() const;
+
+    // Adds the time spent in stage during one frame
+    void record(const FrameStage& stage, const uint64_t& ns);
+    // Adds the bytes written for one frame and counts it
+    void record_frame(const uint64_t& bytes, const StatsClock::time_point& end);
+    // Keeps a span of stage for the trace, bytes is shown with it
+    void trace(const FrameStage& stage, const StatsClock::time_point& start,
+        const StatsClock::time_point& end, const uint64_t& bytes = 0);
+
+    const Histogram& get_histogram(const FrameStage& stage) const;
+    const Histogram& get_bytes_histogram() const;
+    // Last value recorded for stage and for the bytes
+    uint64_t get_last_ns(const FrameStage& stage) const;
+    uint64_t get_last_bytes() const;
+    uint64_t get_frames() const;
+    // Smoothed over the last few frames
+    double get_fps() const;
+
+    // One line with the last frame, e.g. for an overlay
+    std::string get_summary() const;
+    // Name and value of every stat, e.g. for diagnostic_msgs
+    std::vector<std::pair<std::string, std::string>> get_values() const;
+
+    // Keeps the last capacity spans for the trace, 0 turns the trace off.
+    // Not safe while recording.
+    void set_trace_capacity(const size_t& capacity);
+    // Writes the spans kept so far as Chrome trace JSON, false on failure
+    bool write_trace(const std::string& path) const;
+
+    static const char* get_stage_name(const FrameStage& stage);
+
+private:
+    // Span of the trace. seq is odd while the span is written, and 2 * (i + 1)
+    // once the i-th span is complete, so that readers can skip torn spans.
+    struct TraceSpan
+    {
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> start_ns;
+        std::atomic<int64_t> duration_ns;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> thread;
+        std::atomic<int> stage;
+    };
+
+    std::atomic<bool> enabled_;
+
+    Histogram stages_[FRAME_STAGE_COUNT];
+    Histogram bytes_;
+    std::atomic<uint64_t> last_ns_[FRAME_STAGE_COUNT];
+    std::atomic<uint64_t> last_bytes_;
+
+    std::atomic<uint64_t> frames_;
+    std::atomic<int64_t> last_frame_end_ns_;
+    std::atomic<double> fps_;
+
+    std::unique_ptr<TraceSpan[]> trace_;
+    size_t trace_capacity_;
+    std::atomic<uint64_t> trace_next_;
+};
+
+/**
+ * Times a stage from its construction to its destruction, e.g. to time the
+ * ingest of a message in a node
+*/
+class StageTimer
+{
+public:
+    StageTimer(FrameStats& stats, const FrameStage& stage);
+    ~StageTimer();
+
+private:
+    FrameStats& stats_;
+    FrameStage stage_;
+    StatsClock::time_point start_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Id of an interned glyph. ASCII characters are their own id, so 0 means no
+ * glyph and ' ' is the space.
+*/
+typedef uint16_t GlyphId;
+
+constexpr GlyphId GLYPH_NONE = 0;
+
+// Longest UTF-8 sequence a glyph can hold, e.g. a character followed by a
+// combining mark or a variation selector
+constexpr size_t GLYPH_MAX_LEN = 8;
+
+/**
+ * Encoded bytes of a glyph. The bytes past len are zero, so all
+ * GLYPH_MAX_LEN of them can be copied at once.
+*/
+struct GlyphSpan
+{
+    char bytes[GLYPH_MAX_LEN];
+    unsigned char len;
+};
+
+/**
+ * Interns the UTF-8 sequences drawn in cells to 16 bit ids, so cells hold and
+ * compare integers and the encoder copies precomputed bytes. Ids are never
+ * freed, once the table is full new sequences are drawn as '?'. Not thread
+ * safe.
+*/
+class GlyphTable
+{
+public:
+    GlyphTable();
+
+    GlyphId intern(const std::string& c);
+    GlyphId intern(const char* c, const size_t& len);
+
+    // Encoded bytes of id, which must come from this table
+    const GlyphSpan& get_span(const GlyphId& id) const;
+    // Encoded bytes of every glyph, indexed by id, until the next intern()
+    const GlyphSpan* get_spans() const;
+
+    size_t size() const;
+
+    // Length of the UTF-8 sequence of one character starting at c, at most
+    // len. Bytes that do not start a sequence count as one character.
+    static size_t get_sequence_len(const char* c, const size_t& len);
+
+private:
+    std::vector<GlyphSpan> spans_;
+    std::unordered_map<std::string, GlyphId> ids_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * How images are sent to the terminal
+*/
+enum ImageProtocol
+{
+    IMAGE_PROTOCOL_CELLS = 0,   // Colored cells, works everywhere
+    IMAGE_PROTOCOL_KITTY,       // Kitty graphics protocol with raw RGB pixels
+    IMAGE_PROTOCOL_KITTY_PNG,   // Kitty graphics protocol with PNG, fewer bytes but slower to encode
+    IMAGE_PROTOCOL_SIXEL        // Sixel, with the 256 color palette
+};
+
+/**
+ * Encodes pixels for the terminal graphics protocols. Images are appended to
+ * out as complete escape sequences that draw at the cursor, so they can be
+ * written along with the cells of a frame.
+*/
+class ImageProtocolEncoder
+{
+public:
+    // Kitty image id that pixels are sent with, ids start at 1. Sending an
+    // id again replaces the image, and it is scaled to cols x rows cells.
+    static void encode_kitty(const unsigned char* rgb, const int& width, const int& height,
+        const int& cols, const int& rows, const int& id, std::vector<char>& out);
+    static void encode_kitty_png(const std::vector<unsigned char>& png,
+        const int& cols, const int& rows, const int& id, std::vector<char>& out);
+    static void encode_kitty_delete(const int& id, std::vector<char>& out);
+
+    static void encode_sixel(const unsigned char* rgb, const int& width, const int& height, std::vector<char>& out);
+
+    // Protocol the terminal advertises in the environment, IMAGE_PROTOCOL_CELLS
+    // if none or inside a multiplexer
+    static ImageProtocol detect();
+    // Parses "cells", "kitty", "kitty_png", "sixel" or "auto", which detects
+    static bool parse(const std::string& name, ImageProtocol& protocol);
+
+private:
+    static void encode_kitty_chunks_(const std::string& control, const unsigned char* data, const size_t& len,
+        std::vector<char>& out);
+    static void append_(std::vector<char>& out, const char* bytes);
+    static void append_uint_(std::vector<char>& out, unsigned int value);
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <utility>
+
+#include <stdint.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Single slot that always holds the newest item, for one producer and one
+ * consumer.
+ *
+ * T is meant to be a handle, like a shared pointer to a cloud, so putting an
+ * item only copies the handle. The items live in three slots: one the
+ * producer fills, one the consumer reads and the newest one in between.
+ * put() swaps its slot with the newest one with an atomic exchange, so the
+ * producer never waits for the consumer and nothing is allocated. An item
+ * that was not taken yet is dropped and counted.
+ *
+ * The mutex is only used to put the consumer to sleep while there is nothing
+ * new, and put() only takes it when the consumer says it is waiting.
+*/
+template <typename T>
+class Mailbox
+{
+public:
+    // Constructors and Destructors
+    Mailbox();
+
+    // Producer side, returns true if an unread item was dropped
+    bool put(const T& item);
+
+    // Consumer side, waits for an item and returns false once closed
+    bool take(T& item);
+
+    // Wakes up the consumer for good
+    void close();
+
+    // Stats
+    uint64_t get_dropped();
+
+private:
+    // Moves the newest item into item if there is one
+    bool try_take_(T& item);
+
+    // Index of the slot in between, with fresh_ set while it was not taken
+    static const unsigned char fresh_ = 4;
+    static const unsigned char index_mask_ = 3;
+
+    T slots_[3];
+    std::atomic<unsigned char> middle_;
+    unsigned char back_;   // Only used by the producer
+    unsigned char front_;  // Only used by the consumer
+
+    std::atomic<bool> waiting_;
+    std::atomic<bool> closed_;
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+/**
+ * Constructor
+*/
+template <typename T>
+Mailbox<T>::Mailbox():
+    middle_(1),
+    back_(0),
+    front_(2),
+    waiting_(false),
+    closed_(false),
+    dropped_(0)
+{
+}
+
+/**
+ * Puts item in the slot, replacing the one that was there
+*/
+template <typename T>
+bool Mailbox<T>::put(const T& item)
+{
+    slots_[back_] = item;
+    unsigned char old = middle_.exchange(back_ | fresh_);
+    back_ = old & index_mask_;
+
+    bool dropped = (old & fresh_) != 0;
+    if (dropped)
+    {
+        // Releases the dropped item now rather than on the next put
+        slots_[back_] = T();
+        dropped_++;
+    }
+
+    // The consumer sets waiting_ before it looks at the slot for the last
+    // time, so either it sees the item or we see it waiting. Taking the lock
+    // makes sure it is asleep before we notify.
+    if (waiting_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_one();
+    }
+
+    return dropped;
+}
+
+/**
+ * Moves the newest item into item, waiting for one if there is nothing new
+*/
+template <typename T>
+bool Mailbox<T>::take(T& item)
+{
+    if (try_take_(item))
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting_ = true;
+    while (true)
+    {
+        if (try_take_(item))
+        {
+            waiting_ = false;
+            return true;
+        }
+        if (closed_)
+        {
+            waiting_ = false;
+            return false;
+        }
+        cv_.wait(lock);
+    }
+}
+
+/**
+ * Makes take() return false once the slot is empty
+*/
+template <typename T>
+void Mailbox<T>::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+/**
+ * Returns the number of items replaced before being taken
+*/
+template <typename T>
+uint64_t Mailbox<T>::get_dropped()
+{
+    return dropped_;
+}
+
+/**
+ * Swaps the newest slot with the one the consumer read last
+*/
+template <typename T>
+bool Mailbox<T>::try_take_(T& item)
+{
+    if (!(middle_.load() & fresh_))
+    {
+        return false;
+    }
+
+    // Only the producer changes the slot in between, and it always leaves
+    // it fresh
+    front_ = middle_.exchange(front_) & index_mask_;
+    item = std::move(slots_[front_]);
+    slots_[front_] = T();
+    return true;
+}
+
+}  // namespace roshell_graphics
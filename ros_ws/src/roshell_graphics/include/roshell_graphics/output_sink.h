@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Where encoded frames go. write() or writev() is called once per frame with
+ * the whole frame, from the drawing thread or from the writer thread if the
+ * output is asynchronous, but never from both at the same time.
+*/
+class OutputSink
+{
+public:
+    virtual ~OutputSink() {}
+
+    virtual void write(const char* data, const size_t& len) = 0;
+
+    // Frame made of several buffers, by default they are copied together and
+    // passed to write()
+    virtual void writev(const struct iovec* iov, const int& iovcnt);
+};
+
+/**
+ * Writes frames to a file descriptor, stdout by default. Given a path, it
+ * opens the file and closes it when destroyed.
+*/
+class FdSink : public OutputSink
+{
+public:
+    // Constructors and Destructors
+    FdSink(int fd = STDOUT_FILENO);
+    FdSink(const std::string& path);
+    ~FdSink();
+
+    void write(const char* data, const size_t& len);
+    void writev(const struct iovec* iov, const int& iovcnt);
+
+    // True if the file could be opened
+    bool is_open();
+
+private:
+    int fd_;
+    bool owns_fd_;
+};
+
+/**
+ * Keeps every frame in memory, e.g. to compare them against golden frames.
+ * It is safe to read the frames while the writer thread adds new ones.
+*/
+class MemorySink : public OutputSink
+{
+public:
+    void write(const char* data, const size_t& len);
+
+    size_t get_num_frames();
+    std::string get_frame(const size_t& i);
+    // All the frames one after the other, as a terminal would receive them
+    std::string get_data();
+    void clear();
+
+private:
+    std::mutex mutex_;
+    std::vector<std::string> frames_;
+};
+
+/**
+ * Drops frames and only counts them, to measure throughput
+*/
+class NullSink : public OutputSink
+{
+public:
+    NullSink();
+
+    void write(const char* data, const size_t& len);
+    void writev(const struct iovec* iov, const int& iovcnt);
+
+    uint64_t get_frames_written();
+    uint64_t get_bytes_written();
+
+private:
+    std::atomic<uint64_t> frames_written_;
+    std::atomic<uint64_t> bytes_written_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+namespace roshell_graphics
+{
+
+/**
+ * RGB values of the 16 standard terminal colors, as used by xterm
+*/
+constexpr unsigned char ANSI_16_PALETTE[16][3] = {
+    {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+    {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+    {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}};
+
+/**
+ * Levels of each channel in the 6x6x6 color cube of the 256 color palette
+*/
+constexpr unsigned char ANSI_256_CUBE_LEVELS[6] = {0, 95, 135, 175, 215, 255};
+
+/**
+ * Maps RGB colors to the nearest entry of the 256 and 16 color palettes.
+ *
+ * The lookup tables are indexed by the top 5 bits of each channel, so they
+ * hold 32768 entries each and are built once per process on first use.
+*/
+class Palette
+{
+public:
+    static unsigned char rgb_to_256(const unsigned char* color);
+    static unsigned char rgb_to_16(const unsigned char* color);
+    // RGB of entry index of the 256 color palette
+    static void index_to_rgb(const unsigned char& index, unsigned char* color);
+
+private:
+    static int lut_index_(const unsigned char* color);
+    static int distance_(const int& r, const int& g, const int& b, const unsigned char* color);
+    static std::vector<unsigned char> build_256_lut_();
+    static std::vector<unsigned char> build_16_lut_();
+};
+
+}  // namespace roshell_graphics
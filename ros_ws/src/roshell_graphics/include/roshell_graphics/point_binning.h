@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace roshell_graphics
+{
+
+// Number of points binned at a time, small enough to stay in the cache
+constexpr size_t POINT_BLOCK_SIZE = 1024;
+
+/**
+ * Instruction sets the kernels are built for, from the slowest to the fastest
+*/
+enum SimdLevel
+{
+    SIMD_LEVEL_SCALAR = 0,  // Plain C++, runs anywhere
+    SIMD_LEVEL_SSE42,       // SSE4.2, any x86-64 CPU since 2008
+    SIMD_LEVEL_AVX2         // AVX2, Haswell and later
+};
+
+/**
+ * Describes how points are mapped to cells. A point p lands on the dot
+ * floor(p * scale + offset), and dots outside of [0, width) x [0, height) are
+ * dropped. Each cell holds 2^cell_bits_x by 2^cell_bits_y dots.
+*/
+struct BinningGrid
+{
+    float scale_x;
+    float offset_x;
+    float scale_y;
+    float offset_y;
+
+    // Size of the grid in dots
+    int width;
+    int height;
+
+    int cell_bits_x;
+    int cell_bits_y;
+};
+
+/**
+ * Describes how points in the world frame are projected. A point p goes to
+ * the camera frame as c = transform * (p, 1), and lands on
+ * (f * c.x / c.z, 0.5 * f * c.y / c.z) in the natural frame, halved
+ * vertically for the lower vertical resolution.
+*/
+struct ProjectionGrid
+{
+    float transform[3][4];  // Rotation and translation, row major
+    float focal_distance;
+};
+
+/**
+ * Converts blocks of points to cell indices and colormap indices.
+ *
+ * Each bin is the index of the cell the point landed on, shifted left by
+ * cell_bits_x + cell_bits_y, with the row and column of the dot within the
+ * cell in the low bits. Dropped points get a bin of -1. Points are read with
+ * a stride (in floats) so that x, y and z can point into the same matrix.
+ *
+ * Every kernel is built for each SimdLevel, and the fastest level the CPU
+ * supports is picked on first use, so the same binary runs on any x86-64 CPU.
+ * The ROSHELL_GRAPHICS_SIMD environment variable (scalar, sse4.2 or avx2)
+ * caps the level. All levels give the same results, up to the sign of NaNs.
+*/
+class PointBinner
+{
+public:
+    static void bin(const BinningGrid& grid, const float* x, const float* y,
+        const size_t& stride, const size_t& n, int32_t* bins);
+
+    // Colormap index of each point, clamp(int(z * slope) + intercept, 0, 255)
+    static void color(const float* z, const size_t& stride, const size_t& n,
+        const float& slope, const int& intercept, unsigned char* colormap_idx);
+
+    // Range of the finite values, false if there are none
+    static bool range(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v);
+
+    // Adds the hit counts and dots of a second histogram into the first, its
+    // colors replace the first ones where they are not 0, or are closer
+    static void merge(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+        const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+        const float* other_depth, const size_t& n);
+
+    // Projects points in the world frame to x, y, z, depth quadruplets, with
+    // x and y in the natural frame, z in the world frame and NaN for the
+    // points behind the camera
+    static void project(const ProjectionGrid& grid, const float* points, const size_t& stride,
+        const size_t& n, float* xyzd);
+
+    // Level of the kernels in use
+    static SimdLevel get_simd_level();
+    // Fastest level that this CPU and this build support
+    static SimdLevel get_max_simd_level();
+    // Switches to the kernels of another level, e.g. to compare them. Returns
+    // false if the level is not supported. Not safe while binning.
+    static bool set_simd_level(const SimdLevel& level);
+    static const char* get_simd_level_name(const SimdLevel& level);
+
+private:
+    // Entry points of the kernels of one level, each one handles all n points
+    struct Kernels
+    {
+        void (*bin)(const BinningGrid& grid, const float* x, const float* y,
+            const size_t& stride, const size_t& n, int32_t* bins);
+        void (*color)(const float* z, const size_t& stride, const size_t& n,
+            const float& slope, const int& intercept, unsigned char* colormap_idx);
+        bool (*range)(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v);
+        void (*merge)(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+            const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+            const float* other_depth, const size_t& n);
+        void (*project)(const ProjectionGrid& grid, const float* points, const size_t& stride,
+            const size_t& n, float* xyzd);
+    };
+
+    struct KernelTable
+    {
+        Kernels kernels[SIMD_LEVEL_AVX2 + 1];
+        SimdLevel max_level;
+        SimdLevel level;
+    };
+
+    static KernelTable& kernel_table_();
+    static const Kernels& kernels_();
+    static SimdLevel detect_simd_level_();
+
+    // Fill in the kernels of a level and return true, or return false if the
+    // build does not have them. Each level is in its own file, built with
+    // the flags of its instruction set.
+    static bool get_scalar_kernels_(Kernels& kernels);
+    static bool get_sse42_kernels_(Kernels& kernels);
+    static bool get_avx2_kernels_(Kernels& kernels);
+
+    // Scalar kernels, also used for the tails of the vectorized ones
+    static void bin_scalar_(const BinningGrid& grid, const float* x, const float* y,
+        const size_t& stride, const size_t& n, int32_t* bins);
+    static void color_scalar_(const float* z, const size_t& stride, const size_t& n,
+        const float& slope, const int& intercept, unsigned char* colormap_idx);
+    static bool range_scalar_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v);
+    static void merge_scalar_(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+        const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+        const float* other_depth, const size_t& n);
+    static void project_scalar_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+        const size_t& n, float* xyzd);
+
+    static void bin_sse42_(const BinningGrid& grid, const float* x, const float* y,
+        const size_t& stride, const size_t& n, int32_t* bins);
+    static void color_sse42_(const float* z, const size_t& stride, const size_t& n,
+        const float& slope, const int& intercept, unsigned char* colormap_idx);
+    static bool range_sse42_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v);
+    static void merge_sse42_(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+        const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+        const float* other_depth, const size_t& n);
+    static void project_sse42_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+        const size_t& n, float* xyzd);
+
+    static void bin_avx2_(const BinningGrid& grid, const float* x, const float* y,
+        const size_t& stride, const size_t& n, int32_t* bins);
+    static void color_avx2_(const float* z, const size_t& stride, const size_t& n,
+        const float& slope, const int& intercept, unsigned char* colormap_idx);
+    static bool range_avx2_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v);
+    static void project_avx2_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+        const size_t& n, float* xyzd);
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "roshell_graphics.h"
+
+namespace roshell_graphics
+{
+
+/**
+ * How much a frame is cut down, relative to what the node was configured with
+*/
+struct QualityLevel
+{
+    int subsampling;            // Factor on the point subsampling
+    ColorDepth color_depth;     // Finest color depth allowed
+    bool low_resolution;        // Density instead of Braille, full instead of half blocks
+};
+
+/**
+ * Picks a QualityLevel that holds a target frame rate and an output budget in
+ * bytes per second, e.g. over a slow SSH link.
+ *
+ * Each frame is fed in with the time it took to render and write and the bytes
+ * it took. The load of a frame is the larger of its time over the time budget
+ * (1 / target_fps) and its bytes over the bytes budget (max_bytes_per_second /
+ * target_fps), smoothed over a few frames. The quality drops one level after a
+ * few frames over budget and comes back one level after a couple of seconds
+ * well under it. An upgrade that is undone right away doubles the wait before
+ * the next one, so the quality does not bounce between two levels.
+*/
+class QualityController
+{
+public:
+    // A max_bytes_per_second of 0 leaves the output unbounded. levels goes
+    // from full quality to the cheapest.
+    QualityController(const double& target_fps, const double& max_bytes_per_second = 0.0,
+        const std::vector<QualityLevel>& levels = get_point_levels());
+
+    // Feeds one frame, returns true if the level changed
+    bool update(const uint64_t& frame_ns, const uint64_t& bytes);
+
+    // 0 is full quality, higher is cheaper
+    int get_level() const;
+    int get_num_levels() const;
+    const QualityLevel& get_quality() const;
+
+    // Smoothed load, above 1 is over budget
+    double get_load() const;
+
+    // Levels for point clouds, and for images, which are not subsampled
+    static const std::vector<QualityLevel>& get_point_levels();
+    static const std::vector<QualityLevel>& get_image_levels();
+
+private:
+    void set_level_(const int& level);
+
+    std::vector<QualityLevel> levels_;
+    double frame_budget_ns_;
+    double bytes_budget_;
+
+    int level_;
+    double load_;
+
+    // Frames since the level changed, and in a row over or well under budget
+    int frames_at_level_;
+    int frames_over_;
+    int frames_under_;
+
+    // Frames well under budget needed to go up a level, doubled when an
+    // upgrade is undone and reset once one holds
+    int recover_frames_;
+    int base_recover_frames_;
+    bool upgraded_;
+};
+
+}  // namespace roshell_graphics
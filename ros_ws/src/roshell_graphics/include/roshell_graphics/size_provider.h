@@ -0,0 +1,82 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+
+#include <signal.h>
+#include <unistd.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Tells the renderer how many cells it can draw into
+*/
+class SizeProvider
+{
+public:
+    virtual ~SizeProvider() {}
+
+    // Returns false if the size is unknown, the renderer then keeps its own
+    virtual bool get_size(int& width, int& height) = 0;
+
+    // Returns true if the size may have changed since the last get_size()
+    virtual bool has_changed() { return true; }
+
+    // Returns false if the size of a cell in pixels is unknown
+    virtual bool get_cell_pixel_size(int& /*width*/, int& /*height*/) { return false; }
+};
+
+/**
+ * Size of the terminal behind a file descriptor, stdout by default. It is
+ * unknown when the file descriptor is not a terminal, e.g. in a pipe.
+ *
+ * The terminal is only asked again after a SIGWINCH. The handler is installed
+ * once per process and calls the handler that was there before, if any.
+*/
+class TerminalSizeProvider : public SizeProvider
+{
+public:
+    TerminalSizeProvider(int fd = STDOUT_FILENO);
+
+    bool get_size(int& width, int& height);
+    bool has_changed();
+    bool get_cell_pixel_size(int& width, int& height);
+
+private:
+    static void install_handler_();
+    static void on_resize_(int signal, siginfo_t* info, void* context);
+
+    int fd_;
+
+    // Resize count seen by the last get_size()
+    bool queried_;
+    unsigned int seen_generation_;
+
+    // Incremented by the SIGWINCH handler
+    static std::atomic<unsigned int> resize_generation_;
+    static struct sigaction previous_action_;
+    static std::once_flag handler_installed_;
+};
+
+/**
+ * Size set by hand, for rendering without a terminal
+*/
+class FixedSizeProvider : public SizeProvider
+{
+public:
+    FixedSizeProvider(const int& width, const int& height);
+
+    bool get_size(int& width, int& height);
+    bool has_changed();
+
+    // Takes effect on the next RoshellGraphics::clear_buffer()
+    void set_size(const int& width, const int& height);
+
+private:
+    std::atomic<int> width_;
+    std::atomic<int> height_;
+    std::atomic<bool> changed_;
+};
+
+}  // namespace roshell_graphics
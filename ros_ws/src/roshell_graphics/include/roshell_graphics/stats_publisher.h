@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "frame_stats.h"
+
+namespace roshell_graphics
+{
+
+/**
+ * Publishes FrameStats on /diagnostics at a fixed rate, as one status named
+ * after the node with the summary as its message and every stat as a value.
+ * Lives in the roshell_graphics_ros library, so that the core library does not
+ * depend on ROS.
+*/
+class StatsPublisher
+{
+public:
+    StatsPublisher(ros::NodeHandle& nh, const std::shared_ptr<FrameStats>& stats, const double& rate);
+
+private:
+    void publish_(const ros::TimerEvent& event);
+
+    std::shared_ptr<FrameStats> stats_;
+    std::string name_;
+
+    ros::Publisher diagnostics_pub_;
+    ros::Timer timer_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+
+#include <stdint.h>
+
+#include "frame_stats.h"
+#include "output_sink.h"
+
+namespace roshell_graphics
+{
+
+/**
+ * Writes encoded frames to an output sink from a dedicated thread.
+ *
+ * Frames are handed over through a double buffer: the frame being written
+ * and the pending frame. submit() swaps the caller's buffer with the pending
+ * one, so the caller can start encoding the next frame right away. If the
+ * terminal is slower than the caller, a pending frame that was not picked up
+ * yet is replaced by the newer one and counted as superseded. Writes are timed
+ * into stats, if given and enabled.
+*/
+class TerminalWriter
+{
+public:
+    // Constructors and Destructors
+    TerminalWriter(const std::shared_ptr<OutputSink>& sink,
+        const std::shared_ptr<FrameStats>& stats = nullptr);
+    ~TerminalWriter();
+
+    // Hands a frame over to the writer thread
+    void submit(std::vector<char>& frame, const size_t& len);
+
+    // True if the last submitted frame was not picked up yet
+    bool has_pending();
+
+    // Stats
+    uint64_t get_frames_written();
+    uint64_t get_frames_superseded();
+
+private:
+    void run_();
+
+    std::shared_ptr<OutputSink> sink_;
+    std::shared_ptr<FrameStats> stats_;
+
+    // Frame waiting to be written, and the one being written
+    std::vector<char> pending_;
+    size_t pending_len_;
+    std::vector<char> writing_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> has_pending_;
+    bool stop_;
+
+    std::atomic<uint64_t> frames_written_;
+    std::atomic<uint64_t> frames_superseded_;
+
+    std::thread thread_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#include <stdint.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Fixed set of threads that run the same job in parallel.
+ *
+ * run() calls job(i) once for every i in [0, size()), with job(0) on the
+ * calling thread and the others on the workers, and returns once all of them
+ * are done. The workers sleep between jobs.
+*/
+class ThreadPool
+{
+public:
+    // Constructors and Destructors
+    ThreadPool(const int& num_threads);
+    ~ThreadPool();
+
+    // Number of threads, including the calling one
+    int size();
+
+    void run(const std::function<void(int)>& job);
+
+private:
+    void worker_(int index);
+
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+
+    // Current job, a new generation wakes the workers up
+    const std::function<void(int)>* job_;
+    uint64_t generation_;
+    int remaining_;
+    bool stop_;
+};
+
+}  // namespace roshell_graphics
@@ -0,0 +1,481 @@
+#include <roshell_graphics/frame_stats.h>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <thread>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, the histogram starts empty
+*/
+Histogram::Histogram()
+{
+    reset();
+}
+
+/**
+ * Adds value to the histogram
+*/
+void Histogram::record(const uint64_t& value)
+{
+    buckets_[get_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * Empties the histogram. Not safe while recording.
+*/
+void Histogram::reset()
+{
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Returns the number of values recorded
+*/
+uint64_t Histogram::get_count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the largest value recorded, 0 if there are none
+*/
+uint64_t Histogram::get_max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the mean of the values recorded, 0 if there are none
+*/
+double Histogram::get_mean() const
+{
+    uint64_t count = get_count();
+    return count > 0 ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0.0;
+}
+
+/**
+ * Returns the upper bound of the bucket holding the p-th percentile, capped at
+ * the largest value so that it is never above it. 0 if there are no values.
+*/
+uint64_t Histogram::get_percentile(const double& p) const
+{
+    // Counted from the buckets so that it matches them
+    uint64_t counts[NUM_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the percentile, 1-based
+    double clamped = (p < 0.0) ? 0.0 : ((p > 100.0) ? 100.0 : p);
+    uint64_t rank = static_cast<uint64_t>(clamped / 100.0 * (total - 1)) + 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = get_bucket_upper_bound(i);
+            uint64_t max = get_max();
+            return (upper < max) ? upper : max;
+        }
+    }
+    return get_max();
+}
+
+/**
+ * Bucket of value, see the class description
+*/
+int Histogram::get_bucket(const uint64_t& value)
+{
+    if (value < 16)
+    {
+        return value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int sub_bucket = (value >> (exponent - 3)) & 7;
+    return 16 + (exponent - 4) * 8 + sub_bucket;
+}
+
+/**
+ * Largest value that falls in bucket
+*/
+uint64_t Histogram::get_bucket_upper_bound(const int& bucket)
+{
+    if (bucket < 16)
+    {
+        return bucket;
+    }
+
+    int exponent = (bucket - 16) / 8 + 4;
+    uint64_t sub_bucket = (bucket - 16) % 8;
+    uint64_t lower = (8 + sub_bucket) << (exponent - 3);
+    return lower + ((static_cast<uint64_t>(1) << (exponent - 3)) - 1);
+}
+
+/**
+ * Constructor, the stats are disabled and there is no trace
+*/
+FrameStats::FrameStats():
+    enabled_(false),
+    last_bytes_(0),
+    frames_(0),
+    last_frame_end_ns_(0),
+    fps_(0.0),
+    trace_capacity_(0),
+    trace_next_(0)
+{
+    for (int i = 0; i < FRAME_STAGE_COUNT; i++)
+    {
+        last_ns_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Starts or stops collecting stats, what was collected is kept
+*/
+void FrameStats::set_enabled(const bool& enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * Returns true if stats are collected
+*/
+bool FrameStats::is_enabled() const
+{
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Adds ns nanoseconds spent in stage during one frame
+*/
+void FrameStats::record(const FrameStage& stage, const uint64_t& ns)
+{
+    stages_[stage].record(ns);
+    last_ns_[stage].store(ns, std::memory_order_relaxed);
+}
+
+/**
+ * Counts a frame that ended at end, after bytes bytes were encoded for it.
+ * Frames are expected to end on a single thread.
+*/
+void FrameStats::record_frame(const uint64_t& bytes, const StatsClock::time_point& end)
+{
+    bytes_.record(bytes);
+    last_bytes_.store(bytes, std::memory_order_relaxed);
+
+    int64_t end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end.time_since_epoch()).count();
+    int64_t last_end_ns = last_frame_end_ns_.exchange(end_ns, std::memory_order_relaxed);
+    if (frames_.fetch_add(1, std::memory_order_relaxed) > 0 && end_ns > last_end_ns)
+    {
+        // Exponential moving average over about 10 frames
+        double fps = 1e9 / (end_ns - last_end_ns);
+        double smoothed = fps_.load(std::memory_order_relaxed);
+        fps_.store(smoothed > 0.0 ? 0.9 * smoothed + 0.1 * fps : fps, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Keeps the span [start, end) of stage in the trace, replacing the oldest one
+ * once the trace is full. Does nothing if there is no trace.
+*/
+void FrameStats::trace(const FrameStage& stage, const StatsClock::time_point& start,
+    const StatsClock::time_point& end, const uint64_t& bytes)
+{
+    if (trace_capacity_ == 0)
+    {
+        return;
+    }
+
+    static const std::hash<std::thread::id> hash_thread;
+
+    uint64_t i = trace_next_.fetch_add(1, std::memory_order_relaxed);
+    TraceSpan& span = trace_[i % trace_capacity_];
+
+    span.seq.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    span.start_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        start.time_since_epoch()).count(), std::memory_order_relaxed);
+    span.duration_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count(), std::memory_order_relaxed);
+    span.bytes.store(bytes, std::memory_order_relaxed);
+    span.thread.store(hash_thread(std::this_thread::get_id()) & 0xFFFFFFFF, std::memory_order_relaxed);
+    span.stage.store(stage, std::memory_order_relaxed);
+    span.seq.store(2 * (i + 1), std::memory_order_release);
+}
+
+/**
+ * Returns the histogram of the time spent in stage per frame, in nanoseconds
+*/
+const Histogram& FrameStats::get_histogram(const FrameStage& stage) const
+{
+    return stages_[stage];
+}
+
+/**
+ * Returns the histogram of the bytes written per frame
+*/
+const Histogram& FrameStats::get_bytes_histogram() const
+{
+    return bytes_;
+}
+
+/**
+ * Returns the time spent in stage by the last frame that recorded it
+*/
+uint64_t FrameStats::get_last_ns(const FrameStage& stage) const
+{
+    return last_ns_[stage].load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the bytes written for the last frame
+*/
+uint64_t FrameStats::get_last_bytes() const
+{
+    return last_bytes_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the number of frames counted
+*/
+uint64_t FrameStats::get_frames() const
+{
+    return frames_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the frame rate, smoothed over the last few frames
+*/
+double FrameStats::get_fps() const
+{
+    return fps_.load(std::memory_order_relaxed);
+}
+
+/**
+ * Returns the time of each stage in the last frame, the bytes it took and the
+ * frame rate, on one line
+*/
+std::string FrameStats::get_summary() const
+{
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (int i = 0; i < FRAME_STAGE_COUNT; i++)
+    {
+        ss << get_stage_name(static_cast<FrameStage>(i)) << " "
+           << last_ns_[i].load(std::memory_order_relaxed) / 1e6 << " ";
+    }
+    ss << "ms | " << std::setprecision(1) << last_bytes_.load(std::memory_order_relaxed) / 1024.0
+       << " KiB | " << get_fps() << " fps";
+    return ss.str();
+}
+
+/**
+ * Returns the mean, median, 99th percentile and max of every stage in
+ * milliseconds, and of the bytes per frame, since the stats were created
+*/
+std::vector<std::pair<std::string, std::string>> FrameStats::get_values() const
+{
+    std::vector<std::pair<std::string, std::string>> values;
+
+    struct Formatter
+    {
+        static std::string format(const double& value, const int& precision)
+        {
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(precision) << value;
+            return ss.str();
+        }
+    };
+
+    values.push_back(std::make_pair("frames", std::to_string(get_frames())));
+    values.push_back(std::make_pair("fps", Formatter::format(get_fps(), 1)));
+
+    for (int i = 0; i < FRAME_STAGE_COUNT; i++)
+    {
+        const Histogram& histogram = stages_[i];
+        std::string name = get_stage_name(static_cast<FrameStage>(i));
+        values.push_back(std::make_pair(name + " mean ms", Formatter::format(histogram.get_mean() / 1e6, 3)));
+        values.push_back(std::make_pair(name + " p50 ms", Formatter::format(histogram.get_percentile(50) / 1e6, 3)));
+        values.push_back(std::make_pair(name + " p99 ms", Formatter::format(histogram.get_percentile(99) / 1e6, 3)));
+        values.push_back(std::make_pair(name + " max ms", Formatter::format(histogram.get_max() / 1e6, 3)));
+    }
+
+    values.push_back(std::make_pair("bytes mean", Formatter::format(bytes_.get_mean(), 0)));
+    values.push_back(std::make_pair("bytes p99", std::to_string(bytes_.get_percentile(99))));
+    values.push_back(std::make_pair("bytes max", std::to_string(bytes_.get_max())));
+    return values;
+}
+
+/**
+ * Allocates room for the last capacity spans, dropping the ones kept so far
+*/
+void FrameStats::set_trace_capacity(const size_t& capacity)
+{
+    trace_.reset(capacity > 0 ? new TraceSpan[capacity] : nullptr);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        trace_[i].seq.store(0, std::memory_order_relaxed);
+    }
+    trace_capacity_ = capacity;
+    trace_next_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Writes the spans kept so far to path as a Chrome trace, one complete event
+ * per span with the time relative to the first one. Spans being written are
+ * skipped.
+*/
+bool FrameStats::write_trace(const std::string& path) const
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+    {
+        return false;
+    }
+
+    uint64_t end = trace_next_.load(std::memory_order_acquire);
+    uint64_t begin = (end > trace_capacity_) ? end - trace_capacity_ : 0;
+
+    struct Span
+    {
+        int64_t start_ns;
+        int64_t duration_ns;
+        uint64_t bytes;
+        uint64_t thread;
+        int stage;
+    };
+    std::vector<Span> spans;
+    spans.reserve(end - begin);
+
+    for (uint64_t i = begin; i < end; i++)
+    {
+        const TraceSpan& slot = trace_[i % trace_capacity_];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * (i + 1))
+        {
+            continue;
+        }
+
+        Span span;
+        span.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        span.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        span.bytes = slot.bytes.load(std::memory_order_relaxed);
+        span.thread = slot.thread.load(std::memory_order_relaxed);
+        span.stage = slot.stage.load(std::memory_order_relaxed);
+
+        // Overwritten while it was read
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+        spans.push_back(span);
+    }
+
+    int64_t origin_ns = 0;
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        if (i == 0 || spans[i].start_ns < origin_ns)
+        {
+            origin_ns = spans[i].start_ns;
+        }
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        const Span& span = spans[i];
+        file << "  {\"name\": \"" << get_stage_name(static_cast<FrameStage>(span.stage))
+             << "\", \"cat\": \"roshell_graphics\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << span.thread
+             << ", \"ts\": " << (span.start_ns - origin_ns) / 1e3
+             << ", \"dur\": " << span.duration_ns / 1e3;
+        if (span.bytes > 0)
+        {
+            file << ", \"args\": {\"bytes\": " << span.bytes << "}";
+        }
+        file << "}" << (i + 1 < spans.size() ? "," : "") << "\n";
+    }
+    file << "]}\n";
+
+    return static_cast<bool>(file);
+}
+
+/**
+ * Returns the name of stage, as used in the summary, the values and the trace
+*/
+const char* FrameStats::get_stage_name(const FrameStage& stage)
+{
+    switch (stage)
+    {
+        case FRAME_STAGE_INGEST:
+            return "ingest";
+        case FRAME_STAGE_PROJECT:
+            return "project";
+        case FRAME_STAGE_RASTERIZE:
+            return "rasterize";
+        case FRAME_STAGE_ENCODE:
+            return "encode";
+        case FRAME_STAGE_WRITE:
+            return "write";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Starts timing stage, if the stats are enabled
+*/
+StageTimer::StageTimer(FrameStats& stats, const FrameStage& stage):
+    stats_(stats),
+    stage_(stage)
+{
+    if (stats_.is_enabled())
+    {
+        start_ = StatsClock::now();
+    }
+}
+
+/**
+ * Records the time since the construction
+*/
+StageTimer::~StageTimer()
+{
+    if (stats_.is_enabled() && start_ != StatsClock::time_point())
+    {
+        StatsClock::time_point end = StatsClock::now();
+        stats_.record(stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count());
+        stats_.trace(stage_, start_, end);
+    }
+}
+
+}  // namespace roshell_graphics
@@ -0,0 +1,130 @@
+#include <roshell_graphics/glyph_table.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, the 128 ASCII characters take the first ids so that they are
+ * interned without a lookup
+*/
+GlyphTable::GlyphTable()
+{
+    spans_.resize(128);
+    memset(spans_.data(), 0, spans_.size() * sizeof(GlyphSpan));
+    for (int c = 1; c < 128; c++)
+    {
+        spans_[c].bytes[0] = static_cast<char>(c);
+        spans_[c].len = 1;
+    }
+}
+
+/**
+ * Returns the id of the UTF-8 sequence c
+*/
+GlyphId GlyphTable::intern(const std::string& c)
+{
+    return intern(c.data(), c.size());
+}
+
+/**
+ * Overloaded method that interns the len bytes starting at c. An empty
+ * sequence is GLYPH_NONE, and a sequence longer than GLYPH_MAX_LEN is cut
+ * down to its first character.
+*/
+GlyphId GlyphTable::intern(const char* c, const size_t& len)
+{
+    if (len == 0)
+    {
+        return GLYPH_NONE;
+    }
+
+    unsigned char first = static_cast<unsigned char>(c[0]);
+    if (len == 1 && first < 128)
+    {
+        return first;
+    }
+
+    size_t glyph_len = (len <= GLYPH_MAX_LEN) ? len : std::min(get_sequence_len(c, len), GLYPH_MAX_LEN);
+    std::string key(c, glyph_len);
+
+    std::unordered_map<std::string, GlyphId>::const_iterator it = ids_.find(key);
+    if (it != ids_.end())
+    {
+        return it->second;
+    }
+
+    // Full, ids are 16 bits
+    if (spans_.size() > UINT16_MAX)
+    {
+        return '?';
+    }
+
+    GlyphId id = spans_.size();
+    GlyphSpan span;
+    memset(&span, 0, sizeof(span));
+    memcpy(span.bytes, c, glyph_len);
+    span.len = glyph_len;
+    spans_.push_back(span);
+    ids_[key] = id;
+    return id;
+}
+
+/**
+ * Returns the encoded bytes of id
+*/
+const GlyphSpan& GlyphTable::get_span(const GlyphId& id) const
+{
+    return spans_[id];
+}
+
+/**
+ * Returns the encoded bytes of all glyphs, e.g. to encode a whole frame
+ * without a call per cell
+*/
+const GlyphSpan* GlyphTable::get_spans() const
+{
+    return spans_.data();
+}
+
+/**
+ * Returns the number of ids in use, including the ASCII ones
+*/
+size_t GlyphTable::size() const
+{
+    return spans_.size();
+}
+
+/**
+ * Returns the length of the UTF-8 sequence starting at c from its first byte.
+ * Continuation bytes and invalid lead bytes are one byte long, so that
+ * malformed text still moves forward.
+*/
+size_t GlyphTable::get_sequence_len(const char* c, const size_t& len)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    unsigned char first = static_cast<unsigned char>(c[0]);
+    size_t sequence_len = 1;
+    if ((first & 0xE0) == 0xC0)
+    {
+        sequence_len = 2;
+    }
+    else if ((first & 0xF0) == 0xE0)
+    {
+        sequence_len = 3;
+    }
+    else if ((first & 0xF8) == 0xF0)
+    {
+        sequence_len = 4;
+    }
+    return std::min(sequence_len, len);
+}
+
+}  // namespace roshell_graphics
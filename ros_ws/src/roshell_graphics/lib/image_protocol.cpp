@@ -0,0 +1,327 @@
+#include <roshell_graphics/image_protocol.h>
+#include <roshell_graphics/palette.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <string.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Appends the escape sequences that send width x height RGB pixels with the
+ * Kitty graphics protocol and place them at the cursor, scaled to cols x rows
+ * cells. The cursor does not move and the terminal does not answer.
+*/
+void ImageProtocolEncoder::encode_kitty(const unsigned char* rgb, const int& width, const int& height,
+    const int& cols, const int& rows, const int& id, std::vector<char>& out)
+{
+    std::string control = "a=T,f=24,s=" + std::to_string(width) + ",v=" + std::to_string(height) +
+        ",c=" + std::to_string(cols) + ",r=" + std::to_string(rows) + ",i=" + std::to_string(id) + ",p=1,C=1,q=2";
+    encode_kitty_chunks_(control, rgb, static_cast<size_t>(width) * height * 3, out);
+}
+
+/**
+ * Overloaded method that sends a PNG, which the terminal decodes
+*/
+void ImageProtocolEncoder::encode_kitty_png(const std::vector<unsigned char>& png,
+    const int& cols, const int& rows, const int& id, std::vector<char>& out)
+{
+    std::string control = "a=T,f=100,c=" + std::to_string(cols) + ",r=" + std::to_string(rows) +
+        ",i=" + std::to_string(id) + ",p=1,C=1,q=2";
+    encode_kitty_chunks_(control, png.data(), png.size(), out);
+}
+
+/**
+ * Appends the escape sequence that deletes the Kitty image id, along with its
+ * pixels
+*/
+void ImageProtocolEncoder::encode_kitty_delete(const int& id, std::vector<char>& out)
+{
+    append_(out, "\033_Ga=d,d=I,q=2,i=");
+    append_uint_(out, id);
+    append_(out, "\033\\");
+}
+
+/**
+ * Appends a sixel image of width x height RGB pixels, drawn at the cursor.
+ * Pixels are mapped to the 256 color palette and only the colors in use are
+ * defined. Each band of six rows is sent once per color in it, with runs of
+ * the same column pattern compressed. The cursor is left on the last band so
+ * that an image reaching the bottom of the screen does not scroll it.
+*/
+void ImageProtocolEncoder::encode_sixel(const unsigned char* rgb, const int& width, const int& height,
+    std::vector<char>& out)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    std::vector<unsigned char> indices(static_cast<size_t>(width) * height);
+    bool used[256] = {false};
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        indices[i] = Palette::rgb_to_256(rgb + 3 * i);
+        used[indices[i]] = true;
+    }
+
+    // Pixels keep their aspect ratio and the background is left as it is
+    append_(out, "\033P0;1q\"1;1;");
+    append_uint_(out, width);
+    out.push_back(';');
+    append_uint_(out, height);
+
+    // Color registers take percentages
+    for (int c = 0; c < 256; c++)
+    {
+        if (used[c])
+        {
+            unsigned char color[3];
+            Palette::index_to_rgb(c, color);
+            out.push_back('#');
+            append_uint_(out, c);
+            append_(out, ";2");
+            for (int k = 0; k < 3; k++)
+            {
+                out.push_back(';');
+                append_uint_(out, (color[k] * 100 + 127) / 255);
+            }
+        }
+    }
+
+    // Rows of the band that each color is on, per column, and the columns it
+    // spans, -1 if it is not in the band
+    std::vector<unsigned char> masks(256 * static_cast<size_t>(width), 0);
+    int first_x[256];
+    int last_x[256];
+    std::fill(last_x, last_x + 256, -1);
+    std::vector<unsigned char> band_colors;
+
+    // Writes count sixels of pattern bits
+    auto append_run = [&out](const int& count, const unsigned char& bits)
+    {
+        char sixel = static_cast<char>(63 + bits);
+        if (count > 3)
+        {
+            out.push_back('!');
+            append_uint_(out, count);
+            out.push_back(sixel);
+        }
+        else
+        {
+            out.insert(out.end(), count, sixel);
+        }
+    };
+
+    for (int band_y = 0; band_y < height; band_y += 6)
+    {
+        band_colors.clear();
+        int band_height = std::min(6, height - band_y);
+        for (int r = 0; r < band_height; r++)
+        {
+            const unsigned char* row = &indices[static_cast<size_t>(band_y + r) * width];
+            for (int x = 0; x < width; x++)
+            {
+                int c = row[x];
+                if (last_x[c] < 0)
+                {
+                    band_colors.push_back(c);
+                    first_x[c] = x;
+                    last_x[c] = x;
+                }
+                first_x[c] = std::min(first_x[c], x);
+                last_x[c] = std::max(last_x[c], x);
+                masks[static_cast<size_t>(c) * width + x] |= 1 << r;
+            }
+        }
+
+        for (size_t k = 0; k < band_colors.size(); k++)
+        {
+            int c = band_colors[k];
+            unsigned char* mask = &masks[static_cast<size_t>(c) * width];
+
+            // Back to the start of the band for every color but the first
+            if (k > 0)
+            {
+                out.push_back('$');
+            }
+            out.push_back('#');
+            append_uint_(out, c);
+
+            if (first_x[c] > 0)
+            {
+                append_run(first_x[c], 0);
+            }
+
+            int run_start = first_x[c];
+            for (int x = first_x[c] + 1; x <= last_x[c] + 1; x++)
+            {
+                if (x > last_x[c] || mask[x] != mask[run_start])
+                {
+                    append_run(x - run_start, mask[run_start]);
+                    run_start = x;
+                }
+            }
+
+            memset(mask + first_x[c], 0, last_x[c] - first_x[c] + 1);
+            last_x[c] = -1;
+        }
+
+        if (band_y + 6 < height)
+        {
+            out.push_back('-');
+        }
+    }
+
+    append_(out, "\033\\");
+}
+
+/**
+ * Returns the protocol the terminal advertises through its environment.
+ * Multiplexers only pass the sequences through when wrapped, so they get
+ * cells. Terminals that support both get Kitty, which is cheaper to encode.
+*/
+ImageProtocol ImageProtocolEncoder::detect()
+{
+    const char* term = std::getenv("TERM");
+    const char* term_program = std::getenv("TERM_PROGRAM");
+    std::string term_name = term ? term : "";
+    std::string program_name = term_program ? term_program : "";
+
+    if (std::getenv("TMUX") || std::getenv("STY") ||
+        term_name.compare(0, 6, "screen") == 0 || term_name.compare(0, 4, "tmux") == 0)
+    {
+        return IMAGE_PROTOCOL_CELLS;
+    }
+
+    if (std::getenv("KITTY_WINDOW_ID") || term_name.find("kitty") != std::string::npos ||
+        term_name.find("ghostty") != std::string::npos || program_name == "ghostty")
+    {
+        return IMAGE_PROTOCOL_KITTY;
+    }
+
+    if (term_name.find("sixel") != std::string::npos || term_name.compare(0, 4, "foot") == 0 ||
+        term_name.compare(0, 6, "mlterm") == 0 || program_name == "WezTerm" || program_name == "iTerm.app")
+    {
+        return IMAGE_PROTOCOL_SIXEL;
+    }
+
+    return IMAGE_PROTOCOL_CELLS;
+}
+
+/**
+ * Parses the name of a protocol, e.g. from a parameter. Returns false if the
+ * name is not known.
+*/
+bool ImageProtocolEncoder::parse(const std::string& name, ImageProtocol& protocol)
+{
+    if (name == "auto")
+    {
+        protocol = detect();
+    }
+    else if (name == "cells")
+    {
+        protocol = IMAGE_PROTOCOL_CELLS;
+    }
+    else if (name == "kitty")
+    {
+        protocol = IMAGE_PROTOCOL_KITTY;
+    }
+    else if (name == "kitty_png")
+    {
+        protocol = IMAGE_PROTOCOL_KITTY_PNG;
+    }
+    else if (name == "sixel")
+    {
+        protocol = IMAGE_PROTOCOL_SIXEL;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Appends data in chunks of at most 4096 base64 bytes, as the Kitty protocol
+ * requires. control goes with the first chunk.
+*/
+void ImageProtocolEncoder::encode_kitty_chunks_(const std::string& control, const unsigned char* data,
+    const size_t& len, std::vector<char>& out)
+{
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // 3 bytes make 4 base64 bytes
+    static const size_t chunk_len = 3072;
+
+    size_t offset = 0;
+    do
+    {
+        size_t n = std::min(chunk_len, len - offset);
+        bool more = offset + n < len;
+
+        append_(out, "\033_G");
+        if (offset == 0)
+        {
+            append_(out, control.c_str());
+            out.push_back(',');
+        }
+        append_(out, more ? "m=1;" : "m=0;");
+
+        size_t start = out.size();
+        out.resize(start + (n + 2) / 3 * 4);
+        char* b64 = &out[start];
+        const unsigned char* in = data + offset;
+        size_t i = 0;
+        for (; i + 3 <= n; i += 3)
+        {
+            unsigned int bits = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+            *b64++ = base64[bits >> 18];
+            *b64++ = base64[(bits >> 12) & 63];
+            *b64++ = base64[(bits >> 6) & 63];
+            *b64++ = base64[bits & 63];
+        }
+        if (i < n)
+        {
+            unsigned int bits = (in[i] << 16) | ((i + 1 < n) ? (in[i + 1] << 8) : 0);
+            *b64++ = base64[bits >> 18];
+            *b64++ = base64[(bits >> 12) & 63];
+            *b64++ = (i + 1 < n) ? base64[(bits >> 6) & 63] : '=';
+            *b64++ = '=';
+        }
+
+        append_(out, "\033\\");
+        offset += n;
+    } while (offset < len);
+}
+
+/**
+ * Appends the zero-terminated bytes
+*/
+void ImageProtocolEncoder::append_(std::vector<char>& out, const char* bytes)
+{
+    out.insert(out.end(), bytes, bytes + strlen(bytes));
+}
+
+/**
+ * Appends value in decimal
+*/
+void ImageProtocolEncoder::append_uint_(std::vector<char>& out, unsigned int value)
+{
+    char digits[10];
+    int len = 0;
+    do
+    {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (len > 0)
+    {
+        out.push_back(digits[--len]);
+    }
+}
+
+}  // namespace roshell_graphics
@@ -0,0 +1,140 @@
+#include <roshell_graphics/line_plotting.h>
+
+namespace roshell_graphics
+{
+
+PlotGraph::PlotGraph()
+{
+}
+
+PlotGraph::~PlotGraph() = default;
+
+void PlotGraph::draw_axis(const std::string& ylabel)
+{
+    /*
+    Define points in the natural frame:
+    origin_: pixel where origin is situated
+    xlimit_: pixel upto which we will draw x-axis
+    ylimit_: pixel upto which we will draw y-axis
+    The plot fills the viewport, which is the whole terminal by default
+    */
+    pad_h_ = static_cast<int>(0.1*(view_height_));
+    pad_w_ = static_cast<int>(0.05*(view_width_));
+
+    origin_ = Eigen::Vector2i((-view_width_/2 + pad_w_ ), (-view_height_/2 + pad_h_));
+    xlimit_ = Eigen::Vector2i((-view_width_/2 + pad_w_ + (0.85*view_width_)), (-view_height_/2 + pad_h_));
+    ylimit_ = Eigen::Vector2i((-view_width_/2 + pad_w_ ), (-view_height_/2 + pad_h_ + (0.85*view_height_)));
+
+    //Points to put text labels
+    Point text_x;
+    if(view_height_ > 28)
+    {
+        text_x = Eigen::Vector2i((xlimit_[0]-5),(xlimit_[1] - 2));
+    }
+    else
+    { 
+        text_x = Eigen::Vector2i((xlimit_[0]+2),(xlimit_[1]));
+    }
+    Point text_y = Eigen::Vector2i((ylimit_[0] - 2),(ylimit_[1] + 1));
+
+    // Draw X-axis and y-axis on terminal
+    add_line(origin_,xlimit_,"-");
+    add_line(origin_,ylimit_,"|");
+
+    // Add labels for X-axis and Y-axis
+    add_text(xlimit_,">");
+    add_text(ylimit_,"^");
+    add_text(text_x,"Time (s)");
+    add_text(text_y,ylabel);
+
+    //Add time axis ticks
+    one_tick_x_ = ((xlimit_[0] - origin_[0])/30);
+    for (int i = 1; i <= 30; i++)
+    {
+        Point mark = Eigen::Vector2i((origin_[0] + (one_tick_x_ * i) ),(origin_[1]));
+        Point value = Eigen::Vector2i((origin_[0] + (one_tick_x_ * i) ),(origin_[1] - 1));
+        add_text(mark,"+");
+        if(i%3==0)
+        {
+            add_text(value,std::to_string(i));
+        }
+    }
+}
+
+void PlotGraph::plot_points(
+    const std::vector<float>& points_list,
+    const float& min_y,
+    const float& max_y,
+    const std::string& ylabel)
+{
+    Point p1 = origin_;
+    Point p2 = origin_;
+    // int min_value = *std::min_element(points_list.begin(), points_list.end());
+    // int max_value = *std::max_element(points_list.begin(), points_list.end());
+    draw_axis(ylabel);
+    const int y_len = (ylimit_[1]-origin_[1]);
+    const int num_points = static_cast<int>(points_list.size());
+
+    // Segments between consecutive points are rasterized in one batch
+    Eigen::Matrix4Xi segments(4, std::max(num_points - 1, 0));
+    std::vector<std::string> segment_glyphs;
+
+    for (int i = 0;i < num_points;i++)
+    {
+        if(i >= 1)
+        {
+            p2=p1;
+        }
+        float distance_from_origin =  ((float) points_list[i] * y_len / max_y);
+
+        p1[0] = origin_[0] + (one_tick_x_*(i+1));
+        p1[1] = origin_[1] + (int)distance_from_origin;
+
+        if(i >= 1)
+        {
+            // Calculate slope
+            float slope = static_cast<float>(p1[1] - p2[1]) / static_cast<float>(p1[0] - p2[0]);
+            if (slope >= -0.8 && slope <= 0.8)
+            {
+                segment_glyphs.push_back("-");
+            }
+            else if (slope > 0.8)
+            {
+                segment_glyphs.push_back("/");
+            }
+            else if (slope < -0.8)
+            {
+                segment_glyphs.push_back("\\");
+            }
+            else
+            {
+                segment_glyphs.push_back("|");
+            }
+            segments.col(i - 1) << p1, p2;
+        }
+    }
+
+    if (!segment_glyphs.empty())
+    {
+        add_lines(segments, segment_glyphs);
+    }
+
+    // Labels go on top of the lines
+    Point y_max_text = Eigen::Vector2i((ylimit_[0] - 4), (ylimit_[1]));
+    Point y_min_text = Eigen::Vector2i((origin_[0] - 4), (origin_[1]));
+
+    add_text(y_max_text, std::to_string(static_cast<int>(max_y)));
+    add_text(y_min_text, std::to_string(static_cast<int>(min_y)));
+
+    for (int i = 0;i < num_points;i++)
+    {
+        p1[0] = origin_[0] + (one_tick_x_*(i+1));
+        p1[1] = origin_[1] + (int)((float) points_list[i] * y_len / max_y);
+
+        float value_to_write = static_cast<float>(static_cast<int>(points_list[i] * 10.)) / 10.;
+        add_text(p1,"*");
+        add_text(Point(p1[0] + 2, p1[1] + 0), std::to_string(value_to_write).substr(0, 4));
+    }
+}
+
+}
@@ -0,0 +1,220 @@
+#include <roshell_graphics/output_sink.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Copies the buffers into one and writes it, unless there is only one
+*/
+void OutputSink::writev(const struct iovec* iov, const int& iovcnt)
+{
+    if (iovcnt == 1)
+    {
+        write(static_cast<const char*>(iov[0].iov_base), iov[0].iov_len);
+        return;
+    }
+
+    std::string data;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        data.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+    write(data.data(), data.size());
+}
+
+/**
+ * Constructor, writes to fd without taking ownership of it
+*/
+FdSink::FdSink(int fd):
+    fd_(fd),
+    owns_fd_(false)
+{
+}
+
+/**
+ * Constructor, creates or truncates the file at path
+*/
+FdSink::FdSink(const std::string& path):
+    fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)),
+    owns_fd_(true)
+{
+}
+
+/**
+ * Destructor, closes the file if it was opened here
+*/
+FdSink::~FdSink()
+{
+    if (owns_fd_ && fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+/**
+ * Writes len bytes of data, retrying on partial writes and interruptions
+*/
+void FdSink::write(const char* data, const size_t& len)
+{
+    size_t remaining = len;
+    while (remaining > 0 && fd_ >= 0)
+    {
+        ssize_t written = ::write(fd_, data, remaining);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        data += written;
+        remaining -= written;
+    }
+}
+
+/**
+ * Writes the buffers in one system call, retrying on partial writes and
+ * interruptions. A partly written buffer is finished on its own.
+*/
+void FdSink::writev(const struct iovec* iov, const int& iovcnt)
+{
+    int i = 0;
+    while (i < iovcnt && fd_ >= 0)
+    {
+        ssize_t written = ::writev(fd_, iov + i, std::min(iovcnt - i, IOV_MAX));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        while (i < iovcnt && static_cast<size_t>(written) >= iov[i].iov_len)
+        {
+            written -= iov[i].iov_len;
+            i++;
+        }
+
+        if (i < iovcnt && written > 0)
+        {
+            write(static_cast<const char*>(iov[i].iov_base) + written, iov[i].iov_len - written);
+            i++;
+        }
+    }
+}
+
+/**
+ * Returns true if there is a file descriptor to write to
+*/
+bool FdSink::is_open()
+{
+    return fd_ >= 0;
+}
+
+/**
+ * Stores a copy of the frame
+*/
+void MemorySink::write(const char* data, const size_t& len)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.push_back(std::string(data, len));
+}
+
+/**
+ * Returns the number of frames written so far
+*/
+size_t MemorySink::get_num_frames()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_.size();
+}
+
+/**
+ * Returns frame i, or an empty string if there is no such frame
+*/
+std::string MemorySink::get_frame(const size_t& i)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return i < frames_.size() ? frames_[i] : std::string();
+}
+
+/**
+ * Returns all the frames concatenated
+*/
+std::string MemorySink::get_data()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string data;
+    for (size_t i = 0; i < frames_.size(); i++)
+    {
+        data += frames_[i];
+    }
+    return data;
+}
+
+/**
+ * Forgets the frames written so far
+*/
+void MemorySink::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.clear();
+}
+
+/**
+ * Constructor
+*/
+NullSink::NullSink():
+    frames_written_(0),
+    bytes_written_(0)
+{
+}
+
+/**
+ * Counts the frame and drops it
+*/
+void NullSink::write(const char* /*data*/, const size_t& len)
+{
+    frames_written_++;
+    bytes_written_ += len;
+}
+
+/**
+ * Counts the frame and drops it, without copying the buffers together
+*/
+void NullSink::writev(const struct iovec* iov, const int& iovcnt)
+{
+    frames_written_++;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        bytes_written_ += iov[i].iov_len;
+    }
+}
+
+/**
+ * Returns the number of frames written so far
+*/
+uint64_t NullSink::get_frames_written()
+{
+    return frames_written_;
+}
+
+/**
+ * Returns the number of bytes written so far
+*/
+uint64_t NullSink::get_bytes_written()
+{
+    return bytes_written_;
+}
+
+}  // namespace roshell_graphics
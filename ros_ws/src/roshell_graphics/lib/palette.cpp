@@ -0,0 +1,142 @@
+#include <roshell_graphics/palette.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <string.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Returns the index of the palette entry closest to color, in [16, 255]
+*/
+unsigned char Palette::rgb_to_256(const unsigned char* color)
+{
+    static const std::vector<unsigned char> lut = build_256_lut_();
+    return lut[lut_index_(color)];
+}
+
+/**
+ * Returns the index of the palette entry closest to color, in [0, 15]
+*/
+unsigned char Palette::rgb_to_16(const unsigned char* color)
+{
+    static const std::vector<unsigned char> lut = build_16_lut_();
+    return lut[lut_index_(color)];
+}
+
+/**
+ * Writes the RGB of entry index of the 256 color palette to color. The 16
+ * system colors are the ones of xterm.
+*/
+void Palette::index_to_rgb(const unsigned char& index, unsigned char* color)
+{
+    if (index < 16)
+    {
+        memcpy(color, ANSI_16_PALETTE[index], 3);
+    }
+    else if (index < 232)
+    {
+        color[0] = ANSI_256_CUBE_LEVELS[(index - 16) / 36];
+        color[1] = ANSI_256_CUBE_LEVELS[(index - 16) / 6 % 6];
+        color[2] = ANSI_256_CUBE_LEVELS[(index - 16) % 6];
+    }
+    else
+    {
+        color[0] = color[1] = color[2] = 8 + 10 * (index - 232);
+    }
+}
+
+/**
+ * Index into the lookup tables
+*/
+int Palette::lut_index_(const unsigned char* color)
+{
+    return ((color[0] >> 3) << 10) | ((color[1] >> 3) << 5) | (color[2] >> 3);
+}
+
+/**
+ * Squared distance between (r, g, b) and color
+*/
+int Palette::distance_(const int& r, const int& g, const int& b, const unsigned char* color)
+{
+    return (r - color[0]) * (r - color[0]) + (g - color[1]) * (g - color[1]) + (b - color[2]) * (b - color[2]);
+}
+
+/**
+ * Builds the 256 color lookup table. The 16 system colors are skipped since
+ * terminals often redefine them. Each entry is the closer of the nearest cube
+ * color, which can be found channel by channel, and the nearest gray.
+*/
+std::vector<unsigned char> Palette::build_256_lut_()
+{
+    std::vector<unsigned char> lut(1 << 15);
+
+    for (int i = 0; i < (1 << 15); i++)
+    {
+        // Center of the bin
+        int r = ((i >> 10) << 3) + 4;
+        int g = (((i >> 5) & 31) << 3) + 4;
+        int b = ((i & 31) << 3) + 4;
+
+        int level[3];
+        int channel[3] = {r, g, b};
+        unsigned char cube_color[3];
+        for (int c = 0; c < 3; c++)
+        {
+            level[c] = 0;
+            for (int l = 1; l < 6; l++)
+            {
+                if (abs(channel[c] - ANSI_256_CUBE_LEVELS[l]) < abs(channel[c] - ANSI_256_CUBE_LEVELS[level[c]]))
+                {
+                    level[c] = l;
+                }
+            }
+            cube_color[c] = ANSI_256_CUBE_LEVELS[level[c]];
+        }
+
+        // Grays go from 8 to 238 in steps of 10
+        int gray_level = std::max(0, std::min(23, ((r + g + b) / 3 - 3) / 10));
+        unsigned char gray = 8 + 10 * gray_level;
+        unsigned char gray_color[3] = {gray, gray, gray};
+
+        if (distance_(r, g, b, gray_color) < distance_(r, g, b, cube_color))
+        {
+            lut[i] = 232 + gray_level;
+        }
+        else
+        {
+            lut[i] = 16 + 36 * level[0] + 6 * level[1] + level[2];
+        }
+    }
+    return lut;
+}
+
+/**
+ * Builds the 16 color lookup table
+*/
+std::vector<unsigned char> Palette::build_16_lut_()
+{
+    std::vector<unsigned char> lut(1 << 15);
+
+    for (int i = 0; i < (1 << 15); i++)
+    {
+        int r = ((i >> 10) << 3) + 4;
+        int g = (((i >> 5) & 31) << 3) + 4;
+        int b = ((i & 31) << 3) + 4;
+
+        int best = 0;
+        for (int p = 1; p < 16; p++)
+        {
+            if (distance_(r, g, b, ANSI_16_PALETTE[p]) < distance_(r, g, b, ANSI_16_PALETTE[best]))
+            {
+                best = p;
+            }
+        }
+        lut[i] = best;
+    }
+    return lut;
+}
+
+}  // namespace roshell_graphics
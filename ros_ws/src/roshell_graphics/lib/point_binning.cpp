@@ -0,0 +1,345 @@
+#include <roshell_graphics/point_binning.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Writes the bin of each of the n points to bins
+*/
+void PointBinner::bin(const BinningGrid& grid, const float* x, const float* y,
+    const size_t& stride, const size_t& n, int32_t* bins)
+{
+    kernels_().bin(grid, x, y, stride, n, bins);
+}
+
+/**
+ * Writes the colormap index of each of the n points to colormap_idx
+*/
+void PointBinner::color(const float* z, const size_t& stride, const size_t& n,
+    const float& slope, const int& intercept, unsigned char* colormap_idx)
+{
+    kernels_().color(z, stride, n, slope, intercept, colormap_idx);
+}
+
+/**
+ * Finds the smallest and largest finite values among n values read with a
+ * stride. NaNs and infinities are skipped since they would break the colormap.
+*/
+bool PointBinner::range(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v)
+{
+    return kernels_().range(v, stride, n, min_v, max_v);
+}
+
+/**
+ * Merges n cells of a histogram into another. Saturates the counts at
+ * UINT16_MAX. depth is optional, when given a color only replaces the first
+ * one if it is strictly closer, so ties keep the earlier point.
+*/
+void PointBinner::merge(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+    const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+    const float* other_depth, const size_t& n)
+{
+    kernels_().merge(count, dots, color, depth, other_count, other_dots, other_color, other_depth, n);
+}
+
+/**
+ * Projects n points, read with a stride (in floats) between consecutive x, y, z
+ * triplets, and writes them to xyzd
+*/
+void PointBinner::project(const ProjectionGrid& grid, const float* points, const size_t& stride,
+    const size_t& n, float* xyzd)
+{
+    kernels_().project(grid, points, stride, n, xyzd);
+}
+
+/**
+ * Returns the level of the kernels in use
+*/
+SimdLevel PointBinner::get_simd_level()
+{
+    return kernel_table_().level;
+}
+
+/**
+ * Returns the fastest level supported by both the CPU and the build
+*/
+SimdLevel PointBinner::get_max_simd_level()
+{
+    return kernel_table_().max_level;
+}
+
+/**
+ * Uses the kernels of level from now on, if they are supported
+*/
+bool PointBinner::set_simd_level(const SimdLevel& level)
+{
+    KernelTable& table = kernel_table_();
+    if (level < SIMD_LEVEL_SCALAR || level > table.max_level)
+    {
+        return false;
+    }
+
+    table.level = level;
+    return true;
+}
+
+/**
+ * Returns the name of level, as accepted by ROSHELL_GRAPHICS_SIMD
+*/
+const char* PointBinner::get_simd_level_name(const SimdLevel& level)
+{
+    switch (level)
+    {
+        case SIMD_LEVEL_SSE42:
+            return "sse4.2";
+        case SIMD_LEVEL_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+/**
+ * Returns the kernels of every level, built on first use. The kernels of the
+ * fastest level the CPU and the build support are used, unless the
+ * ROSHELL_GRAPHICS_SIMD environment variable asks for a slower one.
+*/
+PointBinner::KernelTable& PointBinner::kernel_table_()
+{
+    struct Builder
+    {
+        static KernelTable build()
+        {
+            KernelTable table;
+            memset(&table, 0, sizeof(table));
+
+            // Each level falls back to the previous one for what it does not vectorize
+            SimdLevel cpu_level = detect_simd_level_();
+            table.max_level = SIMD_LEVEL_SCALAR;
+            get_scalar_kernels_(table.kernels[SIMD_LEVEL_SCALAR]);
+            if (cpu_level >= SIMD_LEVEL_SSE42 && get_sse42_kernels_(table.kernels[SIMD_LEVEL_SSE42]))
+            {
+                table.max_level = SIMD_LEVEL_SSE42;
+                if (cpu_level >= SIMD_LEVEL_AVX2 && get_avx2_kernels_(table.kernels[SIMD_LEVEL_AVX2]))
+                {
+                    table.max_level = SIMD_LEVEL_AVX2;
+                }
+            }
+            table.level = table.max_level;
+
+            const char* requested = getenv("ROSHELL_GRAPHICS_SIMD");
+            if (requested && *requested)
+            {
+                bool known = false;
+                for (int level = SIMD_LEVEL_SCALAR; level <= SIMD_LEVEL_AVX2; level++)
+                {
+                    if (strcmp(requested, get_simd_level_name(static_cast<SimdLevel>(level))) == 0)
+                    {
+                        table.level = std::min(table.level, static_cast<SimdLevel>(level));
+                        known = true;
+                    }
+                }
+                if (!known)
+                {
+                    std::cerr << "ROSHELL_GRAPHICS_SIMD: unknown level " << requested
+                              << ", expected scalar, sse4.2 or avx2" << std::endl;
+                }
+            }
+            return table;
+        }
+    };
+
+    static KernelTable table = Builder::build();
+    return table;
+}
+
+/**
+ * Returns the kernels in use
+*/
+const PointBinner::Kernels& PointBinner::kernels_()
+{
+    KernelTable& table = kernel_table_();
+    return table.kernels[table.level];
+}
+
+/**
+ * Asks the CPU which instruction sets it has. This also checks that the OS
+ * saves the AVX registers, without which AVX2 cannot be used.
+*/
+SimdLevel PointBinner::detect_simd_level_()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMD_LEVEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return SIMD_LEVEL_SSE42;
+    }
+#endif
+    return SIMD_LEVEL_SCALAR;
+}
+
+/**
+ * Scalar kernels, always available
+*/
+bool PointBinner::get_scalar_kernels_(Kernels& kernels)
+{
+    kernels.bin = &PointBinner::bin_scalar_;
+    kernels.color = &PointBinner::color_scalar_;
+    kernels.range = &PointBinner::range_scalar_;
+    kernels.merge = &PointBinner::merge_scalar_;
+    kernels.project = &PointBinner::project_scalar_;
+    return true;
+}
+
+/**
+ * Scalar kernel, also handles the tail of the vectorized ones
+*/
+void PointBinner::bin_scalar_(const BinningGrid& grid, const float* x, const float* y,
+    const size_t& stride, const size_t& n, int32_t* bins)
+{
+    int cells_width = grid.width >> grid.cell_bits_x;
+    int mask_x = (1 << grid.cell_bits_x) - 1;
+    int mask_y = (1 << grid.cell_bits_y) - 1;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        float fx = x[i * stride] * grid.scale_x + grid.offset_x;
+        float fy = y[i * stride] * grid.scale_y + grid.offset_y;
+
+        // Also drops NaNs
+        if (!(fx >= 0.0f && fx < grid.width && fy >= 0.0f && fy < grid.height))
+        {
+            bins[i] = -1;
+            continue;
+        }
+
+        int dot_x = static_cast<int>(fx);
+        int dot_y = static_cast<int>(fy);
+        int cell = (dot_y >> grid.cell_bits_y) * cells_width + (dot_x >> grid.cell_bits_x);
+        bins[i] = (cell << (grid.cell_bits_x + grid.cell_bits_y)) |
+            ((dot_y & mask_y) << grid.cell_bits_x) | (dot_x & mask_x);
+    }
+}
+
+/**
+ * Scalar kernel, also handles the tail of the vectorized ones
+*/
+void PointBinner::color_scalar_(const float* z, const size_t& stride, const size_t& n,
+    const float& slope, const int& intercept, unsigned char* colormap_idx)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // Clamped before the conversion so that it stays defined
+        float value = z[i * stride] * slope;
+        value = (value > -1e9f) ? std::min(value, 1e9f) : -1e9f;
+
+        int64_t idx = static_cast<int64_t>(value) + intercept;
+        colormap_idx[i] = static_cast<unsigned char>(std::max<int64_t>(0, std::min<int64_t>(idx, 255)));
+    }
+}
+
+/**
+ * Scalar kernel, also handles the tail of the vectorized ones
+*/
+bool PointBinner::range_scalar_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v)
+{
+    // Two sets of accumulators to shorten the dependency chains
+    float min_a = FLT_MAX, min_b = FLT_MAX;
+    float max_a = -FLT_MAX, max_b = -FLT_MAX;
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        float a = v[i * stride];
+        float b = v[(i + 1) * stride];
+        if (a >= -FLT_MAX && a <= FLT_MAX)
+        {
+            min_a = std::min(min_a, a);
+            max_a = std::max(max_a, a);
+        }
+        if (b >= -FLT_MAX && b <= FLT_MAX)
+        {
+            min_b = std::min(min_b, b);
+            max_b = std::max(max_b, b);
+        }
+    }
+    if (i < n && v[i * stride] >= -FLT_MAX && v[i * stride] <= FLT_MAX)
+    {
+        min_a = std::min(min_a, v[i * stride]);
+        max_a = std::max(max_a, v[i * stride]);
+    }
+
+    min_v = std::min(min_a, min_b);
+    max_v = std::max(max_a, max_b);
+    return min_v <= max_v;
+}
+
+/**
+ * Scalar kernel, also handles the tail of the vectorized ones
+*/
+void PointBinner::merge_scalar_(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+    const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+    const float* other_depth, const size_t& n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        count[i] = std::min<uint32_t>(count[i] + other_count[i], UINT16_MAX);
+        dots[i] |= other_dots[i];
+
+        if (depth)
+        {
+            if (other_depth[i] < depth[i])
+            {
+                depth[i] = other_depth[i];
+                color[i] = other_color[i];
+            }
+        }
+        else if (other_color[i])
+        {
+            color[i] = other_color[i];
+        }
+    }
+}
+
+/**
+ * Scalar kernel, also handles the tail of the vectorized ones. The vectorized
+ * kernels do the same operations in the same order, without fused
+ * multiply-adds, so that every level projects to the same floats.
+*/
+void PointBinner::project_scalar_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+    const size_t& n, float* xyzd)
+{
+    const float (*T)[4] = grid.transform;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        float x = points[i * stride];
+        float y = points[i * stride + 1];
+        float z = points[i * stride + 2];
+
+        float x_cam = T[0][0] * x + T[0][1] * y + T[0][2] * z + T[0][3];
+        float y_cam = T[1][0] * x + T[1][1] * y + T[1][2] * z + T[1][3];
+        float z_cam = T[2][0] * x + T[2][1] * y + T[2][2] * z + T[2][3];
+
+        // NaNs are dropped when binning
+        float scale = (z_cam > 0) ? grid.focal_distance / z_cam : NAN;
+        xyzd[4 * i] = x_cam * scale;
+        xyzd[4 * i + 1] = 0.5f * y_cam * scale;
+        xyzd[4 * i + 2] = z;
+        xyzd[4 * i + 3] = z_cam;
+    }
+}
+
+}  // namespace roshell_graphics
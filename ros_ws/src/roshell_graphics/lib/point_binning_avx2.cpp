@@ -0,0 +1,248 @@
+#include <roshell_graphics/point_binning.h>
+
+/**
+ * AVX2 kernels, this file is built with -mavx2 and only called on CPUs that
+ * have it. As for SSE4.2, nothing here may use inline functions from other
+ * headers. FMA is left out on purpose, so the results match the other levels.
+*/
+
+#if defined(__AVX2__)
+
+#include <cfloat>
+#include <math.h>
+#include <immintrin.h>
+
+namespace roshell_graphics
+{
+
+namespace
+{
+
+/**
+ * Offsets of 8 consecutive points, in floats
+*/
+__m256i point_offsets(const size_t& stride)
+{
+    return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+}
+
+}  // namespace
+
+/**
+ * AVX2 kernels where they are faster, SSE4.2 ones elsewhere
+*/
+bool PointBinner::get_avx2_kernels_(Kernels& kernels)
+{
+    if (!get_sse42_kernels_(kernels))
+    {
+        return false;
+    }
+
+    kernels.bin = &PointBinner::bin_avx2_;
+    kernels.color = &PointBinner::color_avx2_;
+    kernels.range = &PointBinner::range_avx2_;
+    kernels.project = &PointBinner::project_avx2_;
+    return true;
+}
+
+/**
+ * Bins 8 points at a time
+*/
+void PointBinner::bin_avx2_(const BinningGrid& grid, const float* x, const float* y,
+    const size_t& stride, const size_t& n, int32_t* bins)
+{
+    const __m256i lanes = point_offsets(stride);
+    const __m256 scale_x = _mm256_set1_ps(grid.scale_x);
+    const __m256 offset_x = _mm256_set1_ps(grid.offset_x);
+    const __m256 scale_y = _mm256_set1_ps(grid.scale_y);
+    const __m256 offset_y = _mm256_set1_ps(grid.offset_y);
+    const __m256 width = _mm256_set1_ps(static_cast<float>(grid.width));
+    const __m256 height = _mm256_set1_ps(static_cast<float>(grid.height));
+    const __m256 zero = _mm256_setzero_ps();
+
+    const __m128i shift_x = _mm_cvtsi32_si128(grid.cell_bits_x);
+    const __m128i shift_y = _mm_cvtsi32_si128(grid.cell_bits_y);
+    const __m128i shift_cell = _mm_cvtsi32_si128(grid.cell_bits_x + grid.cell_bits_y);
+    const __m256i mask_x = _mm256_set1_epi32((1 << grid.cell_bits_x) - 1);
+    const __m256i mask_y = _mm256_set1_epi32((1 << grid.cell_bits_y) - 1);
+    const __m256i cells_width = _mm256_set1_epi32(grid.width >> grid.cell_bits_x);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 fx = _mm256_i32gather_ps(x + i * stride, lanes, 4);
+        __m256 fy = _mm256_i32gather_ps(y + i * stride, lanes, 4);
+        fx = _mm256_add_ps(_mm256_mul_ps(fx, scale_x), offset_x);
+        fy = _mm256_add_ps(_mm256_mul_ps(fy, scale_y), offset_y);
+
+        __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(fx, zero, _CMP_GE_OQ), _mm256_cmp_ps(fx, width, _CMP_LT_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(fy, zero, _CMP_GE_OQ), _mm256_cmp_ps(fy, height, _CMP_LT_OQ)));
+
+        // Positive inside the grid, so truncating is flooring
+        __m256i dot_x = _mm256_cvttps_epi32(fx);
+        __m256i dot_y = _mm256_cvttps_epi32(fy);
+
+        __m256i cell = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srl_epi32(dot_y, shift_y), cells_width),
+            _mm256_srl_epi32(dot_x, shift_x));
+        __m256i bin = _mm256_or_si256(
+            _mm256_sll_epi32(cell, shift_cell),
+            _mm256_or_si256(
+                _mm256_sll_epi32(_mm256_and_si256(dot_y, mask_y), shift_x),
+                _mm256_and_si256(dot_x, mask_x)));
+
+        // -1 for the points outside of the grid
+        bin = _mm256_blendv_epi8(_mm256_set1_epi32(-1), bin, _mm256_castps_si256(inside));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bins + i), bin);
+    }
+
+    bin_scalar_(grid, x + i * stride, y + i * stride, stride, n - i, bins + i);
+}
+
+/**
+ * Colors 8 points at a time
+*/
+void PointBinner::color_avx2_(const float* z, const size_t& stride, const size_t& n,
+    const float& slope, const int& intercept, unsigned char* colormap_idx)
+{
+    const __m256i lanes = point_offsets(stride);
+    const __m256 slope_v = _mm256_set1_ps(slope);
+    const __m256 low = _mm256_set1_ps(-1e9f);
+    const __m256 high = _mm256_set1_ps(1e9f);
+    const __m256i intercept_v = _mm256_set1_epi32(intercept);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // max returns its second operand for NaNs
+        __m256 value = _mm256_mul_ps(_mm256_i32gather_ps(z + i * stride, lanes, 4), slope_v);
+        value = _mm256_min_ps(_mm256_max_ps(value, low), high);
+        __m256i idx = _mm256_add_epi32(_mm256_cvttps_epi32(value), intercept_v);
+
+        // Saturating packs clamp to [0, 255]
+        __m128i idx16 = _mm_packs_epi32(_mm256_castsi256_si128(idx), _mm256_extracti128_si256(idx, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(colormap_idx + i), _mm_packus_epi16(idx16, idx16));
+    }
+
+    color_scalar_(z + i * stride, stride, n - i, slope, intercept, colormap_idx + i);
+}
+
+/**
+ * Looks at 8 values at a time, non-finite ones are swapped for values that
+ * cannot change the range
+*/
+bool PointBinner::range_avx2_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v)
+{
+    const __m256i lanes = point_offsets(stride);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 highest = _mm256_set1_ps(FLT_MAX);
+    const __m256 lowest = _mm256_set1_ps(-FLT_MAX);
+    __m256 min_8 = highest;
+    __m256 max_8 = lowest;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 value = _mm256_i32gather_ps(v + i * stride, lanes, 4);
+
+        // False for NaNs too
+        __m256 finite = _mm256_cmp_ps(_mm256_and_ps(value, abs_mask), highest, _CMP_LE_OQ);
+        min_8 = _mm256_min_ps(min_8, _mm256_blendv_ps(highest, value, finite));
+        max_8 = _mm256_max_ps(max_8, _mm256_blendv_ps(lowest, value, finite));
+    }
+
+    float tail_min, tail_max;
+    range_scalar_(v + i * stride, stride, n - i, tail_min, tail_max);
+
+    __m128 min_4 = _mm_min_ps(_mm256_castps256_ps128(min_8), _mm256_extractf128_ps(min_8, 1));
+    __m128 max_4 = _mm_max_ps(_mm256_castps256_ps128(max_8), _mm256_extractf128_ps(max_8, 1));
+    min_4 = _mm_min_ps(min_4, _mm_shuffle_ps(min_4, min_4, _MM_SHUFFLE(1, 0, 3, 2)));
+    min_4 = _mm_min_ps(min_4, _mm_shuffle_ps(min_4, min_4, _MM_SHUFFLE(2, 3, 0, 1)));
+    max_4 = _mm_max_ps(max_4, _mm_shuffle_ps(max_4, max_4, _MM_SHUFFLE(1, 0, 3, 2)));
+    max_4 = _mm_max_ps(max_4, _mm_shuffle_ps(max_4, max_4, _MM_SHUFFLE(2, 3, 0, 1)));
+    min_v = _mm_cvtss_f32(_mm_min_ss(min_4, _mm_set_ss(tail_min)));
+    max_v = _mm_cvtss_f32(_mm_max_ss(max_4, _mm_set_ss(tail_max)));
+    return min_v <= max_v;
+}
+
+/**
+ * Projects 8 points at a time
+*/
+void PointBinner::project_avx2_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+    const size_t& n, float* xyzd)
+{
+    const __m256i lanes = point_offsets(stride);
+    __m256 T[3][4];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            T[r][c] = _mm256_set1_ps(grid.transform[r][c]);
+        }
+    }
+    const __m256 focal_distance = _mm256_set1_ps(grid.focal_distance);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 nan = _mm256_set1_ps(NAN);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const float* p = points + i * stride;
+        __m256 x = _mm256_i32gather_ps(p, lanes, 4);
+        __m256 y = _mm256_i32gather_ps(p + 1, lanes, 4);
+        __m256 z = _mm256_i32gather_ps(p + 2, lanes, 4);
+
+        __m256 cam[3];
+        for (int r = 0; r < 3; r++)
+        {
+            cam[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(T[r][0], x), _mm256_mul_ps(T[r][1], y)), _mm256_mul_ps(T[r][2], z)), T[r][3]);
+        }
+
+        __m256 scale = _mm256_blendv_ps(nan, _mm256_div_ps(focal_distance, cam[2]),
+            _mm256_cmp_ps(cam[2], zero, _CMP_GT_OQ));
+        __m256 out_x = _mm256_mul_ps(cam[0], scale);
+        __m256 out_y = _mm256_mul_ps(_mm256_mul_ps(half, cam[1]), scale);
+        __m256 out_d = cam[2];
+
+        // From one register per coordinate to one per pair of points, the
+        // 128 bit lanes hold points 0-3 and 4-7
+        __m256 xy_low = _mm256_unpacklo_ps(out_x, out_y);
+        __m256 xy_high = _mm256_unpackhi_ps(out_x, out_y);
+        __m256 zd_low = _mm256_unpacklo_ps(z, out_d);
+        __m256 zd_high = _mm256_unpackhi_ps(z, out_d);
+        __m256 p04 = _mm256_shuffle_ps(xy_low, zd_low, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 p15 = _mm256_shuffle_ps(xy_low, zd_low, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 p26 = _mm256_shuffle_ps(xy_high, zd_high, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 p37 = _mm256_shuffle_ps(xy_high, zd_high, _MM_SHUFFLE(3, 2, 3, 2));
+
+        float* out = xyzd + 4 * i;
+        _mm256_storeu_ps(out, _mm256_permute2f128_ps(p04, p15, 0x20));
+        _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+        _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+        _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+    }
+
+    project_scalar_(grid, points + i * stride, stride, n - i, xyzd + 4 * i);
+}
+
+}  // namespace roshell_graphics
+
+#else
+
+namespace roshell_graphics
+{
+
+/**
+ * Built without AVX2, e.g. for another architecture
+*/
+bool PointBinner::get_avx2_kernels_(Kernels&)
+{
+    return false;
+}
+
+}  // namespace roshell_graphics
+
+#endif
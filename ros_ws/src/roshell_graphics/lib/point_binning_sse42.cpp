@@ -0,0 +1,277 @@
+#include <roshell_graphics/point_binning.h>
+
+/**
+ * SSE4.2 kernels, this file is built with -msse4.2 and only called on CPUs
+ * that have it. Nothing here may use inline functions from other headers:
+ * they would be built for SSE4.2 too, and the linker could pick that copy
+ * for the rest of the library.
+*/
+
+#if defined(__SSE4_2__)
+
+#include <cfloat>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * SSE4.2 kernels where they are faster, scalar ones elsewhere
+*/
+bool PointBinner::get_sse42_kernels_(Kernels& kernels)
+{
+    get_scalar_kernels_(kernels);
+    kernels.bin = &PointBinner::bin_sse42_;
+    kernels.color = &PointBinner::color_sse42_;
+    kernels.range = &PointBinner::range_sse42_;
+    kernels.merge = &PointBinner::merge_sse42_;
+    kernels.project = &PointBinner::project_sse42_;
+    return true;
+}
+
+/**
+ * Bins 4 points at a time
+*/
+void PointBinner::bin_sse42_(const BinningGrid& grid, const float* x, const float* y,
+    const size_t& stride, const size_t& n, int32_t* bins)
+{
+    const __m128 scale_x = _mm_set1_ps(grid.scale_x);
+    const __m128 offset_x = _mm_set1_ps(grid.offset_x);
+    const __m128 scale_y = _mm_set1_ps(grid.scale_y);
+    const __m128 offset_y = _mm_set1_ps(grid.offset_y);
+    const __m128 width = _mm_set1_ps(static_cast<float>(grid.width));
+    const __m128 height = _mm_set1_ps(static_cast<float>(grid.height));
+    const __m128 zero = _mm_setzero_ps();
+
+    const __m128i shift_x = _mm_cvtsi32_si128(grid.cell_bits_x);
+    const __m128i shift_y = _mm_cvtsi32_si128(grid.cell_bits_y);
+    const __m128i shift_cell = _mm_cvtsi32_si128(grid.cell_bits_x + grid.cell_bits_y);
+    const __m128i mask_x = _mm_set1_epi32((1 << grid.cell_bits_x) - 1);
+    const __m128i mask_y = _mm_set1_epi32((1 << grid.cell_bits_y) - 1);
+    const __m128i cells_width = _mm_set1_epi32(grid.width >> grid.cell_bits_x);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* px = x + i * stride;
+        const float* py = y + i * stride;
+        __m128 fx = _mm_set_ps(px[3 * stride], px[2 * stride], px[stride], px[0]);
+        __m128 fy = _mm_set_ps(py[3 * stride], py[2 * stride], py[stride], py[0]);
+        fx = _mm_add_ps(_mm_mul_ps(fx, scale_x), offset_x);
+        fy = _mm_add_ps(_mm_mul_ps(fy, scale_y), offset_y);
+
+        __m128 inside = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmplt_ps(fx, width)),
+            _mm_and_ps(_mm_cmpge_ps(fy, zero), _mm_cmplt_ps(fy, height)));
+
+        // Positive inside the grid, so truncating is flooring
+        __m128i dot_x = _mm_cvttps_epi32(fx);
+        __m128i dot_y = _mm_cvttps_epi32(fy);
+
+        __m128i cell = _mm_add_epi32(
+            _mm_mullo_epi32(_mm_srl_epi32(dot_y, shift_y), cells_width),
+            _mm_srl_epi32(dot_x, shift_x));
+        __m128i bin = _mm_or_si128(
+            _mm_sll_epi32(cell, shift_cell),
+            _mm_or_si128(
+                _mm_sll_epi32(_mm_and_si128(dot_y, mask_y), shift_x),
+                _mm_and_si128(dot_x, mask_x)));
+
+        // -1 for the points outside of the grid
+        bin = _mm_blendv_epi8(_mm_set1_epi32(-1), bin, _mm_castps_si128(inside));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bins + i), bin);
+    }
+
+    bin_scalar_(grid, x + i * stride, y + i * stride, stride, n - i, bins + i);
+}
+
+/**
+ * Colors 4 points at a time
+*/
+void PointBinner::color_sse42_(const float* z, const size_t& stride, const size_t& n,
+    const float& slope, const int& intercept, unsigned char* colormap_idx)
+{
+    const __m128 slope_v = _mm_set1_ps(slope);
+    const __m128 low = _mm_set1_ps(-1e9f);
+    const __m128 high = _mm_set1_ps(1e9f);
+    const __m128i intercept_v = _mm_set1_epi32(intercept);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* pz = z + i * stride;
+        __m128 value = _mm_mul_ps(_mm_set_ps(pz[3 * stride], pz[2 * stride], pz[stride], pz[0]), slope_v);
+
+        // max returns its second operand for NaNs
+        value = _mm_min_ps(_mm_max_ps(value, low), high);
+        __m128i idx = _mm_add_epi32(_mm_cvttps_epi32(value), intercept_v);
+
+        // Saturating packs clamp to [0, 255]
+        idx = _mm_packs_epi32(idx, idx);
+        int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(idx, idx));
+        memcpy(colormap_idx + i, &packed, sizeof(packed));
+    }
+
+    color_scalar_(z + i * stride, stride, n - i, slope, intercept, colormap_idx + i);
+}
+
+/**
+ * Looks at 4 values at a time, non-finite ones are swapped for values that
+ * cannot change the range
+*/
+bool PointBinner::range_sse42_(const float* v, const size_t& stride, const size_t& n, float& min_v, float& max_v)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 highest = _mm_set1_ps(FLT_MAX);
+    const __m128 lowest = _mm_set1_ps(-FLT_MAX);
+    __m128 min_4 = highest;
+    __m128 max_4 = lowest;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* pv = v + i * stride;
+        __m128 value = _mm_set_ps(pv[3 * stride], pv[2 * stride], pv[stride], pv[0]);
+
+        // False for NaNs too
+        __m128 finite = _mm_cmple_ps(_mm_and_ps(value, abs_mask), highest);
+        min_4 = _mm_min_ps(min_4, _mm_blendv_ps(highest, value, finite));
+        max_4 = _mm_max_ps(max_4, _mm_blendv_ps(lowest, value, finite));
+    }
+
+    float tail_min, tail_max;
+    range_scalar_(v + i * stride, stride, n - i, tail_min, tail_max);
+
+    min_4 = _mm_min_ps(min_4, _mm_shuffle_ps(min_4, min_4, _MM_SHUFFLE(1, 0, 3, 2)));
+    min_4 = _mm_min_ps(min_4, _mm_shuffle_ps(min_4, min_4, _MM_SHUFFLE(2, 3, 0, 1)));
+    max_4 = _mm_max_ps(max_4, _mm_shuffle_ps(max_4, max_4, _MM_SHUFFLE(1, 0, 3, 2)));
+    max_4 = _mm_max_ps(max_4, _mm_shuffle_ps(max_4, max_4, _MM_SHUFFLE(2, 3, 0, 1)));
+    min_v = _mm_cvtss_f32(_mm_min_ss(min_4, _mm_set_ss(tail_min)));
+    max_v = _mm_cvtss_f32(_mm_max_ss(max_4, _mm_set_ss(tail_max)));
+    return min_v <= max_v;
+}
+
+/**
+ * Merges 16 cells at a time. The loop is memory bound, so the AVX2 level uses
+ * this kernel too.
+*/
+void PointBinner::merge_sse42_(uint16_t* count, unsigned char* dots, uint16_t* color, float* depth,
+    const uint16_t* other_count, const unsigned char* other_dots, const uint16_t* other_color,
+    const float* other_depth, const size_t& n)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        for (size_t half = i; half < i + 16; half += 8)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(count + half));
+            __m128i other_c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other_count + half));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(count + half), _mm_adds_epu16(c, other_c));
+
+            __m128i col = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color + half));
+            __m128i other_col = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other_color + half));
+
+            __m128i replace;
+            if (depth)
+            {
+                __m128 d_low = _mm_loadu_ps(depth + half);
+                __m128 d_high = _mm_loadu_ps(depth + half + 4);
+                __m128 other_d_low = _mm_loadu_ps(other_depth + half);
+                __m128 other_d_high = _mm_loadu_ps(other_depth + half + 4);
+
+                // Depths are never NaN, cells without a color are at infinity
+                replace = _mm_packs_epi32(
+                    _mm_castps_si128(_mm_cmplt_ps(other_d_low, d_low)),
+                    _mm_castps_si128(_mm_cmplt_ps(other_d_high, d_high)));
+                _mm_storeu_ps(depth + half, _mm_min_ps(other_d_low, d_low));
+                _mm_storeu_ps(depth + half + 4, _mm_min_ps(other_d_high, d_high));
+            }
+            else
+            {
+                replace = _mm_xor_si128(_mm_cmpeq_epi16(other_col, zero), _mm_set1_epi16(-1));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(color + half), _mm_blendv_epi8(col, other_col, replace));
+        }
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dots + i));
+        __m128i other_d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other_dots + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dots + i), _mm_or_si128(d, other_d));
+    }
+
+    merge_scalar_(count + i, dots + i, color + i, depth ? depth + i : NULL,
+        other_count + i, other_dots + i, other_color + i, depth ? other_depth + i : NULL, n - i);
+}
+
+/**
+ * Projects 4 points at a time
+*/
+void PointBinner::project_sse42_(const ProjectionGrid& grid, const float* points, const size_t& stride,
+    const size_t& n, float* xyzd)
+{
+    __m128 T[3][4];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            T[r][c] = _mm_set1_ps(grid.transform[r][c]);
+        }
+    }
+    const __m128 focal_distance = _mm_set1_ps(grid.focal_distance);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 nan = _mm_set1_ps(NAN);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const float* p = points + i * stride;
+        __m128 x = _mm_set_ps(p[3 * stride], p[2 * stride], p[stride], p[0]);
+        __m128 y = _mm_set_ps(p[3 * stride + 1], p[2 * stride + 1], p[stride + 1], p[1]);
+        __m128 z = _mm_set_ps(p[3 * stride + 2], p[2 * stride + 2], p[stride + 2], p[2]);
+
+        __m128 cam[3];
+        for (int r = 0; r < 3; r++)
+        {
+            cam[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(T[r][0], x), _mm_mul_ps(T[r][1], y)), _mm_mul_ps(T[r][2], z)), T[r][3]);
+        }
+
+        __m128 scale = _mm_blendv_ps(nan, _mm_div_ps(focal_distance, cam[2]), _mm_cmpgt_ps(cam[2], zero));
+        __m128 out_x = _mm_mul_ps(cam[0], scale);
+        __m128 out_y = _mm_mul_ps(_mm_mul_ps(half, cam[1]), scale);
+        __m128 out_d = cam[2];
+
+        // From one register per coordinate to one per point
+        _MM_TRANSPOSE4_PS(out_x, out_y, z, out_d);
+        _mm_storeu_ps(xyzd + 4 * i, out_x);
+        _mm_storeu_ps(xyzd + 4 * i + 4, out_y);
+        _mm_storeu_ps(xyzd + 4 * i + 8, z);
+        _mm_storeu_ps(xyzd + 4 * i + 12, out_d);
+    }
+
+    project_scalar_(grid, points + i * stride, stride, n - i, xyzd + 4 * i);
+}
+
+}  // namespace roshell_graphics
+
+#else
+
+namespace roshell_graphics
+{
+
+/**
+ * Built without SSE4.2, e.g. for another architecture
+*/
+bool PointBinner::get_sse42_kernels_(Kernels&)
+{
+    return false;
+}
+
+}  // namespace roshell_graphics
+
+#endif
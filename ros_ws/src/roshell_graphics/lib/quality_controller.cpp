@@ -0,0 +1,173 @@
+#include <roshell_graphics/quality_controller.h>
+
+#include <algorithm>
+
+namespace roshell_graphics
+{
+
+// Smoothing of the load, weight of the newest frame
+static const double load_weight = 0.25;
+
+// Load above which the quality drops, and below which it may come back
+static const double degrade_load = 1.0;
+static const double recover_load = 0.5;
+
+// Frames over budget in a row before the quality drops
+static const int degrade_frames = 3;
+
+// Frames ignored after a change, while the new level shows its cost
+static const int settle_frames = 3;
+
+// Longest wait before an upgrade, as a multiple of the base one
+static const int max_recover_backoff = 8;
+
+/**
+ * Constructor, starts at the first of levels, which must not be empty
+*/
+QualityController::QualityController(const double& target_fps, const double& max_bytes_per_second,
+    const std::vector<QualityLevel>& levels):
+    levels_(levels),
+    frame_budget_ns_(target_fps > 0.0 ? 1e9 / target_fps : 0.0),
+    bytes_budget_((target_fps > 0.0 && max_bytes_per_second > 0.0) ? max_bytes_per_second / target_fps : 0.0),
+    level_(0),
+    load_(0.0),
+    frames_at_level_(0),
+    frames_over_(0),
+    frames_under_(0),
+    upgraded_(false)
+{
+    // About two seconds at the target rate
+    base_recover_frames_ = std::max(10, static_cast<int>(2.0 * target_fps));
+    recover_frames_ = base_recover_frames_;
+}
+
+/**
+ * Adds a frame that took frame_ns to render and write and bytes to send, and
+ * moves one level down or up if the load calls for it
+*/
+bool QualityController::update(const uint64_t& frame_ns, const uint64_t& bytes)
+{
+    double load = (frame_budget_ns_ > 0.0) ? frame_ns / frame_budget_ns_ : 0.0;
+    if (bytes_budget_ > 0.0)
+    {
+        load = std::max(load, bytes / bytes_budget_);
+    }
+
+    frames_at_level_++;
+    if (frames_at_level_ <= settle_frames)
+    {
+        // Start the average over, the previous level cost something else
+        load_ = (frames_at_level_ == 1) ? load : load_ + load_weight * (load - load_);
+        return false;
+    }
+    load_ += load_weight * (load - load_);
+
+    // Only frames that are over budget themselves count, so that the average
+    // lagging behind one slow frame does not drop the quality
+    frames_over_ = (load_ > degrade_load && load > degrade_load) ? frames_over_ + 1 : 0;
+    frames_under_ = (load_ < recover_load) ? frames_under_ + 1 : 0;
+
+    // An upgrade that held long enough resets the wait for the next one
+    if (upgraded_ && frames_at_level_ > recover_frames_)
+    {
+        upgraded_ = false;
+        recover_frames_ = base_recover_frames_;
+    }
+
+    if (frames_over_ >= degrade_frames && level_ + 1 < get_num_levels())
+    {
+        if (upgraded_)
+        {
+            recover_frames_ = std::min(2 * recover_frames_, max_recover_backoff * base_recover_frames_);
+            upgraded_ = false;
+        }
+        set_level_(level_ + 1);
+        return true;
+    }
+
+    if (frames_under_ >= recover_frames_ && level_ > 0)
+    {
+        upgraded_ = true;
+        set_level_(level_ - 1);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns the current level, 0 being full quality
+*/
+int QualityController::get_level() const
+{
+    return level_;
+}
+
+/**
+ * Returns the number of levels, the last one being the cheapest
+*/
+int QualityController::get_num_levels() const
+{
+    return levels_.size();
+}
+
+/**
+ * Returns what the current level cuts down
+*/
+const QualityLevel& QualityController::get_quality() const
+{
+    return levels_[level_];
+}
+
+/**
+ * Returns the smoothed load, the larger of time and bytes over their budgets
+*/
+double QualityController::get_load() const
+{
+    return load_;
+}
+
+/**
+ * Levels of point clouds from full quality to the cheapest. Subsampling is the
+ * cheapest to give up and the color depth saves bytes on slow links, the
+ * resolution goes last since it is the most visible.
+*/
+const std::vector<QualityLevel>& QualityController::get_point_levels()
+{
+    static const std::vector<QualityLevel> levels = {
+        {1, COLOR_DEPTH_TRUECOLOR, false},
+        {2, COLOR_DEPTH_TRUECOLOR, false},
+        {2, COLOR_DEPTH_256, false},
+        {4, COLOR_DEPTH_256, false},
+        {4, COLOR_DEPTH_256, true},
+        {8, COLOR_DEPTH_16, true},
+        {16, COLOR_DEPTH_16, true}};
+    return levels;
+}
+
+/**
+ * Levels of images, the point levels without the steps that only subsample,
+ * which would cost a level without saving anything
+*/
+const std::vector<QualityLevel>& QualityController::get_image_levels()
+{
+    static const std::vector<QualityLevel> levels = {
+        {1, COLOR_DEPTH_TRUECOLOR, false},
+        {1, COLOR_DEPTH_256, false},
+        {1, COLOR_DEPTH_256, true},
+        {1, COLOR_DEPTH_16, true}};
+    return levels;
+}
+
+/**
+ * Moves to level and starts measuring it afresh
+*/
+void QualityController::set_level_(const int& level)
+{
+    level_ = level;
+    frames_at_level_ = 0;
+    frames_over_ = 0;
+    frames_under_ = 0;
+}
+
+}  // namespace roshell_graphics
@@ -0,0 +1,2012 @@
+#include <roshell_graphics/roshell_graphics.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, draws to the terminal behind stdout
+ */
+RoshellGraphics::RoshellGraphics():
+    RoshellGraphics(std::make_shared<FdSink>(STDOUT_FILENO), std::make_shared<TerminalSizeProvider>(STDOUT_FILENO))
+{
+    std::cout << "Terminal Shape (w, h): " << term_width_ << ", " << term_height_ << std::endl;
+    std::cout << "Term Type: " << (term_type_ ? term_type_ : "") << std::endl;
+    std::cout << "Term Color: " << (term_color_ ? term_color_ : "") << std::endl;
+}
+
+/**
+ * Constructor, draws to any sink. The color depth is still picked from the
+ * environment, set_color_depth() makes the output reproducible.
+ */
+RoshellGraphics::RoshellGraphics(const std::shared_ptr<OutputSink>& sink,
+    const std::shared_ptr<SizeProvider>& size_provider):
+    sink_(sink),
+    size_provider_(size_provider),
+    stats_(std::make_shared<FrameStats>())
+{
+    // Defaults
+    term_height_ = 40; 
+    term_width_ = 150;
+
+    std::ios::sync_with_stdio(false);
+
+    update_buffer();
+
+    term_type_ = std::getenv("TERM");
+    term_color_ = std::getenv("COLORTERM");
+
+    // Pick the color depth from what the terminal advertises
+    if (term_color_ && (strcmp(term_color_, "truecolor") == 0 || strcmp(term_color_, "24bit") == 0))
+    {
+        color_depth_ = COLOR_DEPTH_TRUECOLOR;
+    }
+    else if (term_type_ && strstr(term_type_, "256color"))
+    {
+        color_depth_ = COLOR_DEPTH_256;
+    }
+    else
+    {
+        color_depth_ = COLOR_DEPTH_16;
+    }
+
+    // Count to char density map, anything denser is drawn as the last one
+    count_to_glyph_map_ = {
+        glyphs_.intern(" "),
+        glyphs_.intern("."),
+        glyphs_.intern(":"),
+        glyphs_.intern("*"),
+        glyphs_.intern("$"),
+        glyphs_.intern("%"),
+        glyphs_.intern("@")};
+
+    // Braille patterns start at U+2800 and the low 8 bits are the dots, which
+    // makes the UTF-8 encoding 0xE2 0xA0+(dots >> 6) 0x80+(dots & 0x3F)
+    dots_to_glyph_map_.resize(256);
+    for (int dots = 0; dots < 256; dots++)
+    {
+        char bytes[3] = {
+            static_cast<char>(0xE2),
+            static_cast<char>(0xA0 | (dots >> 6)),
+            static_cast<char>(0x80 | (dots & 0x3F))};
+        dots_to_glyph_map_[dots] = glyphs_.intern(bytes, 3);
+    }
+
+    block_glyph_ = glyphs_.intern("█");
+    half_block_glyph_ = glyphs_.intern("▀");
+}
+
+/**
+ * Destructor
+ */
+RoshellGraphics::~RoshellGraphics()
+{
+
+}
+
+/**
+ * Adds the time from its construction to its destruction to the rasterize
+ * time of the frame, unless it is nested in another one, e.g. add_natural_frame()
+ * calling add_line(). Does nothing if the stats are disabled.
+*/
+struct RoshellGraphics::RasterizeTimer
+{
+    RasterizeTimer(RoshellGraphics& rg):
+        rg_(rg)
+    {
+        if (rg_.raster_depth_++ == 0 && rg_.stats_->is_enabled())
+        {
+            start_ = StatsClock::now();
+        }
+    }
+
+    ~RasterizeTimer()
+    {
+        if (--rg_.raster_depth_ == 0 && start_ != StatsClock::time_point())
+        {
+            StatsClock::time_point end = StatsClock::now();
+            rg_.rasterize_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count();
+            rg_.stats_->trace(FRAME_STAGE_RASTERIZE, start_, end);
+        }
+    }
+
+    RoshellGraphics& rg_;
+    StatsClock::time_point start_;
+};
+
+/**
+ * This function asks the size provider for the terminal shape and clears the
+ * buffer. The current shape is kept if the size provider does not know it,
+ * e.g. when stdout is not a terminal. The viewport is reset to the whole
+ * terminal, since the old one may no longer fit.
+ */
+void RoshellGraphics::update_buffer()
+{
+    int width, height;
+    if (size_provider_->get_size(width, height))
+    {
+        // The front buffer no longer matches the screen if the shape changed
+        if (height != term_height_ || width != term_width_)
+        {
+            front_valid_ = false;
+        }
+
+        term_height_ = height;
+        term_width_ = width;
+    }
+
+    // Only used to size images sent with the image protocol
+    int cell_width, cell_height;
+    if (size_provider_->get_cell_pixel_size(cell_width, cell_height))
+    {
+        cell_pixel_width_ = cell_width;
+        cell_pixel_height_ = cell_height;
+    }
+
+    reset_viewport();
+    reset_buffer_();
+}
+
+/**
+ * Clear the buffer. The terminal shape is only updated if the size provider
+ * saw it change, e.g. after a SIGWINCH, so this is cheap to call every frame.
+ * The viewport is kept unless the shape changed.
+*/
+void RoshellGraphics::clear_buffer()
+{
+    if (size_provider_->has_changed())
+    {
+        update_buffer();
+    }
+    else
+    {
+        reset_buffer_();
+    }
+}
+
+/**
+ * Empties every cell by starting a new generation, the cells themselves are
+ * only touched when the shape changed or the generation wraps around
+*/
+void RoshellGraphics::reset_buffer_()
+{
+    int buffer_len = term_height_ * term_width_;
+
+    // New cells are zeroed, so they are stale
+    buffer_.resize(buffer_len);
+    if (depth_test_)
+    {
+        depth_.resize(buffer_len);
+    }
+
+    generation_++;
+    if (generation_ == 0)
+    {
+        if (buffer_len > 0)
+        {
+            memset(buffer_.data(), 0, buffer_len * sizeof(Cell));
+        }
+        generation_ = 1;
+    }
+
+    images_.clear();
+    image_bytes_.clear();
+    kitty_images_ = 0;
+}
+
+/**
+ * Returns the cell at index idx for writing, claiming it first if it is stale.
+ * Every write to the buffer goes through here, hence inline.
+*/
+inline Cell& RoshellGraphics::cell_(const int& idx)
+{
+    Cell& cell = buffer_[idx];
+    if (cell.generation != generation_)
+    {
+        claim_cell_(idx);
+    }
+    return cell;
+}
+
+/**
+ * Empties the cell at index idx and stamps it with the current generation.
+ * Kept out of cell_() so the check for fresh cells stays small.
+*/
+void RoshellGraphics::claim_cell_(const int& idx)
+{
+    Cell& cell = buffer_[idx];
+    memset(&cell, 0, sizeof(Cell));
+    cell.generation = generation_;
+    if (depth_test_)
+    {
+        depth_[idx] = INFINITY;
+    }
+}
+
+/**
+ * Fill buffer given encoded index and a character (optional)
+*/
+void RoshellGraphics::fill_buffer(const int& idx, const std::string& c)
+{
+    GlyphId glyph = line_glyph_(c);
+    if (glyph != GLYPH_NONE)
+    {
+        fill_glyph_(idx, glyph);
+    }
+    else
+    {
+        Cell& cell = cell_(idx);
+        if (cell.count < UINT16_MAX)
+        {
+            cell.count++;
+        }
+    }
+}
+
+/**
+ * Sets the glyph of the cell at index idx
+*/
+void RoshellGraphics::fill_glyph_(const int& idx, const GlyphId& glyph)
+{
+    cell_(idx).glyph = glyph;
+}
+
+/**
+ * Returns the glyph that c sets, or GLYPH_NONE for a space, which counts hits
+ * instead so that the character is picked by the density
+*/
+GlyphId RoshellGraphics::line_glyph_(const std::string& c)
+{
+    // ASCII characters are their own id, no need to call into the table
+    GlyphId glyph = (c.size() == 1 && static_cast<unsigned char>(c[0]) < 128) ?
+        static_cast<unsigned char>(c[0]) : glyphs_.intern(c);
+    return (glyph != ' ') ? glyph : GLYPH_NONE;
+}
+
+/**
+ * Overloaded method that takes in a Point in screen coordinates to fill the buffer
+ * if in bounds.
+*/
+void RoshellGraphics::fill_buffer(const Point& p, const std::string& c)
+{
+    if (is_within_limits_(p))
+    {
+        int idx = encode_point_(p);
+        fill_buffer(idx, c);
+    }
+}
+
+/**
+ * Overloaded method that takes in a Point in screen coordinates to fill the buffer
+ * if in bounds and also adds color to it
+*/
+void RoshellGraphics::fill_buffer(const Point& p, const std::vector<unsigned char>& color, const std::string& c)
+{
+    if (is_within_limits_(p))
+    {
+        int idx = encode_point_(p);
+        fill_buffer(idx, c);
+        fill_color(idx, color);
+    }
+}
+
+/**
+ * This color fills the color buffer with the color_str at index idx
+*/
+void RoshellGraphics::fill_color(const int& idx, const std::vector<unsigned char>& color)
+{
+    fill_color(idx, color.data());
+}
+
+/**
+ * Overloaded method that takes the color as a pointer to 3 RGB bytes
+*/
+void RoshellGraphics::fill_color(const int& idx, const unsigned char* color)
+{
+    Cell& cell = cell_(idx);
+    cell.color[0] = color[0];
+    cell.color[1] = color[1];
+    cell.color[2] = color[2];
+    cell.color_type = CELL_COLOR_RGB;
+}
+
+/**
+ * Sets the background color of the cell at index idx
+*/
+void RoshellGraphics::fill_bg_color_(const int& idx, const unsigned char* color)
+{
+    Cell& cell = cell_(idx);
+    cell.bg_color[0] = color[0];
+    cell.bg_color[1] = color[1];
+    cell.bg_color[2] = color[2];
+    cell.has_bg = 1;
+}
+
+/**
+ * Colors the cell at index idx with an entry of the colormap
+*/
+void RoshellGraphics::fill_colormap_(const int& idx, const int& colormap_idx)
+{
+    Cell& cell = cell_(idx);
+    cell.color[0] = TURBO_COLORMAP[colormap_idx][0];
+    cell.color[1] = TURBO_COLORMAP[colormap_idx][1];
+    cell.color[2] = TURBO_COLORMAP[colormap_idx][2];
+    cell.color_type = CELL_COLOR_MAP;
+    cell.colormap_idx = colormap_idx;
+}
+
+/**
+ * Writes the decimal digits of value
+*/
+char* RoshellGraphics::write_uint_(char* out, unsigned int value)
+{
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (n > 0)
+    {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+/**
+ * Writes the escape sequence that sets color as the foreground color, or as the
+ * background color if background is set
+*/
+char* RoshellGraphics::write_rgb_escape_(char* out, const unsigned char* color, const bool& background)
+{
+    // set color using ANSI escape sequences
+    // Excelent explanation here:
+    // https://stackoverflow.com/questions/4842424/list-of-ansi-color-escape-sequences
+    memcpy(out, background ? "\033[48;2;" : "\033[38;2;", 7);
+    out = write_uint_(out + 7, color[0]);
+    *out++ = ';';
+    out = write_uint_(out, color[1]);
+    *out++ = ';';
+    out = write_uint_(out, color[2]);
+    *out++ = 'm';
+    return out;
+}
+
+/**
+ * Writes the escape sequence that moves the cursor to the encoded index
+*/
+char* RoshellGraphics::write_cursor_escape_(char* out, const int& index)
+{
+    Point p = decode_index_(index);
+
+    // Terminal rows and columns are 1-based
+    *out++ = '\033';
+    *out++ = '[';
+    out = write_uint_(out, p(1) + 1);
+    *out++ = ';';
+    out = write_uint_(out, p(0) + 1);
+    *out++ = 'H';
+    return out;
+}
+
+/**
+ * Writes the escape sequence that sets color as the foreground (or background)
+ * color, quantized to the palette of color_depth
+*/
+char* RoshellGraphics::write_color_escape_(char* out, const unsigned char* color,
+    const ColorDepth& color_depth, const bool& background)
+{
+    if (color_depth == COLOR_DEPTH_TRUECOLOR)
+    {
+        return write_rgb_escape_(out, color, background);
+    }
+
+    *out++ = '\033';
+    *out++ = '[';
+
+    if (color_depth == COLOR_DEPTH_256)
+    {
+        memcpy(out, background ? "48;5;" : "38;5;", 5);
+        out = write_uint_(out + 5, Palette::rgb_to_256(color));
+    }
+    else
+    {
+        // 30-37 and 90-97 for the foreground, 40-47 and 100-107 for the background
+        unsigned char idx = Palette::rgb_to_16(color);
+        unsigned int code = (idx < 8) ? 30 + idx : 90 + idx - 8;
+        out = write_uint_(out, background ? code + 10 : code);
+    }
+
+    *out++ = 'm';
+    return out;
+}
+
+/**
+ * Returns the escape sequences for all colormap entries at color_depth, built
+ * on first use
+*/
+const std::vector<RoshellGraphics::EscapeSequence>& RoshellGraphics::colormap_escapes_(const ColorDepth& color_depth)
+{
+    struct Builder
+    {
+        static std::vector<EscapeSequence> build(const ColorDepth& color_depth)
+        {
+            std::vector<EscapeSequence> escapes(COLORMAP_SIZE);
+            for (int i = 0; i < COLORMAP_SIZE; i++)
+            {
+                char* end = write_color_escape_(escapes[i].bytes, TURBO_COLORMAP[i], color_depth);
+                escapes[i].len = end - escapes[i].bytes;
+            }
+            return escapes;
+        }
+    };
+
+    static const std::vector<EscapeSequence> escapes[3] = {
+        Builder::build(COLOR_DEPTH_TRUECOLOR),
+        Builder::build(COLOR_DEPTH_256),
+        Builder::build(COLOR_DEPTH_16)};
+    return escapes[color_depth];
+}
+
+
+/**
+ * Sets the Braille dot at (dot_x, dot_y) of the viewport, where each cell is 2
+ * dots wide and 4 dots high. Returns the index of the cell, or -1 if the dot
+ * is outside of the viewport.
+*/
+int RoshellGraphics::fill_dot_(const int& dot_x, const int& dot_y)
+{
+    if (dot_x < 0 || dot_x >= 2 * view_width_ || dot_y < 0 || dot_y >= 4 * view_height_)
+    {
+        return -1;
+    }
+
+    int idx = (view_y_ + (dot_y >> 2)) * term_width_ + view_x_ + (dot_x >> 1);
+    cell_(idx).dots |= BRAILLE_DOT_BITS[dot_y & 3][dot_x & 1];
+    return idx;
+}
+
+/**
+ * Sets how points and lines are put into the cells. In RASTER_MODE_BRAILLE each
+ * cell holds 2x4 dots, so the fractional part of point coordinates is used.
+*/
+void RoshellGraphics::set_raster_mode(const RasterMode& raster_mode)
+{
+    raster_mode_ = raster_mode;
+}
+
+/**
+ * Adds points in natural frame to the buffer
+*/
+void RoshellGraphics::add_points(const Eigen::Matrix2Xf& points)
+{
+    RasterizeTimer timer(*this);
+
+    add_points(points.data(), points.data() + 1, NULL, 2, points.cols());
+}
+
+/**
+ * Overloaded add_points function that adds points and also adds color
+*/
+void RoshellGraphics::add_points(const Eigen::Matrix3Xf& points)
+{
+    RasterizeTimer timer(*this);
+
+    float min_val, max_val;
+    if (PointBinner::range(points.data() + 2, 3, points.cols(), min_val, max_val))
+    {
+        add_points(points.data(), points.data() + 1, points.data() + 2, 3, points.cols(), min_val, max_val);
+    }
+    else
+    {
+        add_points(points.data(), points.data() + 1, NULL, 3, points.cols());
+    }
+}
+
+/**
+ * Overloaded add_points function that reads n points in natural frame straight
+ * from memory, with a stride (in floats) between consecutive points. If z is
+ * given, values in [min_z, max_z] are spread over the colormap.
+*/
+void RoshellGraphics::add_points(const float* x, const float* y, const float* z,
+    const size_t& stride, const size_t& n, const float& min_z, const float& max_z)
+{
+    RasterizeTimer timer(*this);
+
+    // The max value lands one past the end of the colormap and gets clamped
+    float slope = (max_z > min_z) ? COLORMAP_SIZE / (max_z - min_z) : 0.0;
+    int intercept = static_cast<int>(-slope * min_z);
+
+    bin_in_parallel_(n, false, [&](PointHistogram& histogram, const size_t& start, const size_t& len)
+    {
+        bin_points_(x + start * stride, y + start * stride, z ? z + start * stride : NULL, NULL,
+            stride, len, slope, intercept, histogram);
+    });
+}
+
+/**
+ * Overloaded add_points function that gets n points from source, one block at
+ * a time, so they can be computed on the fly (and in parallel). source writes
+ * x, y, z, depth quadruplets. z is only used if colored, and depth only if the
+ * depth test is on.
+*/
+void RoshellGraphics::add_points(const PointSource& source, const size_t& n, const bool& colored,
+    const float& min_z, const float& max_z)
+{
+    RasterizeTimer timer(*this);
+
+    float slope = (max_z > min_z) ? COLORMAP_SIZE / (max_z - min_z) : 0.0;
+    int intercept = static_cast<int>(-slope * min_z);
+
+    // Time spent in source is the project time. Threads get equal shares, so
+    // only the calling one, which bins into the first histogram, is timed.
+    bool time_source = stats_->is_enabled();
+    uint64_t source_ns = 0;
+
+    bin_in_parallel_(n, depth_test_, [&](PointHistogram& histogram, const size_t& start, const size_t& len)
+    {
+        bool timed = time_source && &histogram == &histograms_[0];
+        float xyzd[4 * POINT_BLOCK_SIZE];
+        for (size_t block_start = 0; block_start < len; block_start += POINT_BLOCK_SIZE)
+        {
+            size_t block_len = std::min(POINT_BLOCK_SIZE, len - block_start);
+            if (timed)
+            {
+                StatsClock::time_point source_start = StatsClock::now();
+                source(start + block_start, block_len, xyzd);
+                source_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    StatsClock::now() - source_start).count();
+            }
+            else
+            {
+                source(start + block_start, block_len, xyzd);
+            }
+            bin_points_(xyzd, xyzd + 1, colored ? xyzd + 2 : NULL, depth_test_ ? xyzd + 3 : NULL,
+                4, block_len, slope, intercept, histogram);
+        }
+    });
+
+    project_ns_ += source_ns;
+}
+
+/**
+ * Turns the depth test on or off. With it on, points given with a depth (by a
+ * PointSource) only color a cell if they are closer than the ones that
+ * colored it before, so the nearest point wins no matter the order. Hit
+ * counts and dots are not affected.
+*/
+void RoshellGraphics::set_depth_test(bool depth_test)
+{
+    depth_test_ = depth_test;
+    if (depth_test_)
+    {
+        depth_.assign(term_width_ * term_height_, INFINITY);
+    }
+    else
+    {
+        depth_.clear();
+    }
+}
+
+/**
+ * Runs job over the n points. Each thread gets a range of points and its own
+ * histogram of the cells of the viewport, so the job never writes to shared
+ * memory, and the histograms are added into the buffer afterwards. Small
+ * clouds get a single histogram and stay on the calling thread. use_depth
+ * tells if the job fills the depth of the histograms.
+*/
+void RoshellGraphics::bin_in_parallel_(const size_t& n, const bool& use_depth,
+    const std::function<void(PointHistogram& histogram, const size_t& start, const size_t& len)>& job)
+{
+    // Below this, clearing and reducing more histograms costs more than it saves
+    static const size_t min_points_per_thread = 16384;
+
+    int num_threads = (pool_ && n >= 2 * min_points_per_thread) ? pool_->size() : 1;
+    int num_cells = view_width_ * view_height_;
+    if (num_cells == 0)
+    {
+        return;
+    }
+    if (histograms_.size() < static_cast<size_t>(num_threads))
+    {
+        histograms_.resize(num_threads);
+    }
+
+    std::function<void(int)> bin_range = [&](int thread)
+    {
+        PointHistogram& histogram = histograms_[thread];
+        histogram.count.assign(num_cells, 0);
+        histogram.dots.assign(num_cells, 0);
+        histogram.color.assign(num_cells, 0);
+        if (use_depth)
+        {
+            histogram.depth.assign(num_cells, INFINITY);
+        }
+
+        size_t start = n * thread / num_threads;
+        size_t end = n * (thread + 1) / num_threads;
+        job(histogram, start, end - start);
+    };
+
+    std::function<void(int)> reduce_band = [&](int thread)
+    {
+        reduce_histograms_(num_threads, use_depth,
+            static_cast<int64_t>(num_cells) * thread / num_threads,
+            static_cast<int64_t>(num_cells) * (thread + 1) / num_threads);
+    };
+
+    if (num_threads > 1)
+    {
+        pool_->run(bin_range);
+        pool_->run(reduce_band);
+    }
+    else
+    {
+        bin_range(0);
+        reduce_band(0);
+    }
+}
+
+/**
+ * Adds the first num_histograms histograms into the buffer for the cells in
+ * [begin, end) of the viewport. They are first merged into the first
+ * histogram with a vectorized kernel, then only the cells that were hit are
+ * updated. Threads get the points in order, so taking the color of the last
+ * thread that hit a cell (or the closest one with the depth test) gives the
+ * same result as binning serially.
+*/
+void RoshellGraphics::reduce_histograms_(const int& num_histograms, const bool& use_depth,
+    const int& begin, const int& end)
+{
+    uint16_t* count = histograms_[0].count.data();
+    unsigned char* dots = histograms_[0].dots.data();
+    uint16_t* color = histograms_[0].color.data();
+    float* depth = use_depth ? histograms_[0].depth.data() : NULL;
+
+    for (int t = 1; t < num_histograms; t++)
+    {
+        const PointHistogram& other = histograms_[t];
+        PointBinner::merge(count + begin, dots + begin, color + begin, depth ? depth + begin : NULL,
+            other.count.data() + begin, other.dots.data() + begin, other.color.data() + begin,
+            depth ? other.depth.data() + begin : NULL, end - begin);
+    }
+
+    // Index of the cell of the buffer, which skips the cells outside of the
+    // viewport at the end of each row
+    int col = begin % view_width_;
+    int idx = (view_y_ + begin / view_width_) * term_width_ + view_x_ + col;
+    for (int i = begin; i < end; i++, idx++, col++)
+    {
+        if (col == view_width_)
+        {
+            col = 0;
+            idx += term_width_ - view_width_;
+        }
+
+        if ((count[i] | dots[i] | color[i]) == 0)
+        {
+            continue;
+        }
+
+        Cell& cell = cell_(idx);
+        cell.count = std::min<uint32_t>(cell.count + count[i], UINT16_MAX);
+        cell.dots |= dots[i];
+
+        if (color[i] && depth)
+        {
+            if (depth[i] < depth_[idx])
+            {
+                depth_[idx] = depth[i];
+                fill_colormap_(idx, color[i] - 1);
+            }
+        }
+        else if (color[i])
+        {
+            fill_colormap_(idx, color[i] - 1);
+        }
+    }
+}
+
+/**
+ * Bins n points, read with a stride (in floats) from x, y, z and depth, into
+ * histogram, which covers the viewport. z is optional, when given the cells
+ * are colored by the colormap. depth is optional too, when given only the
+ * closest point colors a cell. Points are processed in blocks that stay in
+ * the cache between the kernels and the scatter.
+*/
+void RoshellGraphics::bin_points_(const float* x, const float* y, const float* z, const float* depth,
+    const size_t& stride, const size_t& n, const float& slope, const int& intercept, PointHistogram& histogram)
+{
+    int32_t bins[POINT_BLOCK_SIZE];
+    unsigned char colormap_idx[POINT_BLOCK_SIZE];
+
+    bool braille = (raster_mode_ == RASTER_MODE_BRAILLE);
+    BinningGrid grid;
+    grid.cell_bits_x = braille ? 1 : 0;
+    grid.cell_bits_y = braille ? 2 : 0;
+    grid.scale_x = 1 << grid.cell_bits_x;
+    grid.scale_y = -(1 << grid.cell_bits_y);
+    grid.offset_x = (view_width_ / 2) << grid.cell_bits_x;
+    grid.offset_y = (view_height_ / 2) << grid.cell_bits_y;
+    grid.width = view_width_ << grid.cell_bits_x;
+    grid.height = view_height_ << grid.cell_bits_y;
+
+    for (size_t start = 0; start < n; start += POINT_BLOCK_SIZE)
+    {
+        size_t len = std::min(POINT_BLOCK_SIZE, n - start);
+        PointBinner::bin(grid, x + start * stride, y + start * stride, stride, len, bins);
+        if (z)
+        {
+            PointBinner::color(z + start * stride, stride, len, slope, intercept, colormap_idx);
+        }
+
+        for (size_t i = 0; i < len; i++)
+        {
+            if (bins[i] < 0)
+            {
+                continue;
+            }
+
+            int idx;
+            if (braille)
+            {
+                idx = bins[i] >> 3;
+                histogram.dots[idx] |= BRAILLE_DOT_BITS[(bins[i] >> 1) & 3][bins[i] & 1];
+            }
+            else
+            {
+                idx = bins[i];
+                if (histogram.count[idx] < UINT16_MAX)
+                {
+                    histogram.count[idx]++;
+                }
+            }
+
+            if (!z)
+            {
+                continue;
+            }
+
+            if (depth)
+            {
+                // Also skips NaNs
+                float point_depth = depth[(start + i) * stride];
+                if (!(point_depth < histogram.depth[idx]))
+                {
+                    continue;
+                }
+                histogram.depth[idx] = point_depth;
+            }
+            histogram.color[idx] = colormap_idx[i] + 1;
+        }
+    }
+}
+
+/**
+ * Draws a line between two points provided in the Natural Reference frame.
+ * In RASTER_MODE_BRAILLE the line is drawn with dots and c is ignored.
+*/
+void RoshellGraphics::add_line(const Point& pp1, const Point& pp2, const std::string& c)
+{
+    RasterizeTimer timer(*this);
+
+    int half_width = view_width_ / 2;
+    int half_height = view_height_ / 2;
+
+    rasterize_line_(
+        static_cast<int64_t>(pp1(0)) + half_width, half_height - static_cast<int64_t>(pp1(1)),
+        static_cast<int64_t>(pp2(0)) + half_width, half_height - static_cast<int64_t>(pp2(1)),
+        line_glyph_(c));
+}
+
+/**
+ * Draws many lines at once. Each column of segments holds the two end points
+ * (x1, y1, x2, y2) of a line in the Natural Reference frame.
+*/
+void RoshellGraphics::add_lines(const Eigen::Matrix4Xi& segments, const std::string& c)
+{
+    RasterizeTimer timer(*this);
+
+    add_lines_(segments, &c, 1);
+}
+
+/**
+ * Overloaded add_lines function where c holds one character per segment
+*/
+void RoshellGraphics::add_lines(const Eigen::Matrix4Xi& segments, const std::vector<std::string>& c)
+{
+    RasterizeTimer timer(*this);
+
+    if (c.size() != 1 && c.size() != static_cast<size_t>(segments.cols()))
+    {
+        std::cerr << "add_lines: expected 1 or " << segments.cols() << " characters, got " << c.size() << std::endl;
+        return;
+    }
+
+    add_lines_(segments, c.data(), c.size());
+}
+
+/**
+ * Draws every segment with c[i], or with c[0] if num_c is 1
+*/
+void RoshellGraphics::add_lines_(const Eigen::Matrix4Xi& segments, const std::string* c, const size_t& num_c)
+{
+    int half_width = view_width_ / 2;
+    int half_height = view_height_ / 2;
+
+    GlyphId glyph = line_glyph_(c[0]);
+
+    for (int i = 0; i < segments.cols(); i++)
+    {
+        if (num_c > 1)
+        {
+            glyph = line_glyph_(c[i]);
+        }
+
+        rasterize_line_(
+            static_cast<int64_t>(segments(0, i)) + half_width, half_height - static_cast<int64_t>(segments(1, i)),
+            static_cast<int64_t>(segments(2, i)) + half_width, half_height - static_cast<int64_t>(segments(3, i)),
+            glyph);
+    }
+}
+
+/**
+ * Draws a line between two points given relative to the top left corner of the
+ * viewport with Bresenham's algorithm, after clipping it to the viewport. If
+ * glyph is GLYPH_NONE the count of each cell is incremented instead of setting
+ * its glyph. In RASTER_MODE_BRAILLE the line is drawn in dot space and glyph
+ * is ignored.
+*/
+void RoshellGraphics::rasterize_line_(int64_t x0, int64_t y0, int64_t x1, int64_t y1, const GlyphId& glyph)
+{
+    bool braille = (raster_mode_ == RASTER_MODE_BRAILLE);
+    if (braille)
+    {
+        x0 *= 2;
+        x1 *= 2;
+        y0 *= 4;
+        y1 *= 4;
+    }
+
+    if (!clip_line_(x0, y0, x1, y1,
+        braille ? 2 * view_width_ : view_width_,
+        braille ? 4 * view_height_ : view_height_))
+    {
+        return;
+    }
+
+    // Moved to the screen frame, which keeps the dots within a cell in place
+    int64_t offset_x = braille ? 2 * view_x_ : view_x_;
+    int64_t offset_y = braille ? 4 * view_y_ : view_y_;
+    x0 += offset_x;
+    x1 += offset_x;
+    y0 += offset_y;
+    y1 += offset_y;
+
+    // The clipped end points are on screen, so ints are enough from here on
+    int x = x0, y = y0;
+    int dx = abs(static_cast<int>(x1) - x), sx = (x < x1) ? 1 : -1;
+    int dy = -abs(static_cast<int>(y1) - y), sy = (y < y1) ? 1 : -1;
+    int err = dx + dy;
+
+    // Copied, since the compiler cannot tell that writing a cell leaves them alone
+    Cell* cells = buffer_.data();
+    const int width = term_width_;
+    const uint32_t generation = generation_;
+
+    while (true)
+    {
+        int idx = braille ? (y >> 2) * width + (x >> 1) : y * width + x;
+        Cell& cell = cells[idx];
+        if (cell.generation != generation)
+        {
+            claim_cell_(idx);
+        }
+
+        if (braille)
+        {
+            cell.dots |= BRAILLE_DOT_BITS[y & 3][x & 1];
+        }
+        else if (glyph != GLYPH_NONE)
+        {
+            cell.glyph = glyph;
+        }
+        else if (cell.count < UINT16_MAX)
+        {
+            cell.count++;
+        }
+
+        if (x == x1 && y == y1)
+        {
+            break;
+        }
+
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+/**
+ * Clips the line between (x0, y0) and (x1, y1) to [0, width) x [0, height) with
+ * the Cohen-Sutherland algorithm. Returns false if the line is fully outside.
+*/
+bool RoshellGraphics::clip_line_(int64_t& x0, int64_t& y0, int64_t& x1, int64_t& y1, const int64_t& width, const int64_t& height)
+{
+    enum { INSIDE = 0, LEFT = 1, RIGHT = 2, ABOVE = 4, BELOW = 8 };
+
+    struct Outcode
+    {
+        static int compute(const int64_t& x, const int64_t& y, const int64_t& width, const int64_t& height)
+        {
+            int code = INSIDE;
+            code |= (x < 0) ? LEFT : ((x >= width) ? RIGHT : INSIDE);
+            code |= (y < 0) ? ABOVE : ((y >= height) ? BELOW : INSIDE);
+            return code;
+        }
+    };
+
+    int code0 = Outcode::compute(x0, y0, width, height);
+    int code1 = Outcode::compute(x1, y1, width, height);
+
+    while (true)
+    {
+        if (!(code0 | code1))       // Both inside
+        {
+            return true;
+        }
+        if (code0 & code1)          // Both on the same outer side
+        {
+            return false;
+        }
+
+        // Move the outside end point to the edge it crosses. Doubles are used
+        // since the products can overflow for points far off screen.
+        int code = code0 ? code0 : code1;
+        double x, y;
+        if (code & BELOW)
+        {
+            y = height - 1;
+            x = x0 + static_cast<double>(x1 - x0) * (y - y0) / (y1 - y0);
+        }
+        else if (code & ABOVE)
+        {
+            y = 0;
+            x = x0 + static_cast<double>(x1 - x0) * (y - y0) / (y1 - y0);
+        }
+        else if (code & RIGHT)
+        {
+            x = width - 1;
+            y = y0 + static_cast<double>(y1 - y0) * (x - x0) / (x1 - x0);
+        }
+        else
+        {
+            x = 0;
+            y = y0 + static_cast<double>(y1 - y0) * (x - x0) / (x1 - x0);
+        }
+
+        if (code == code0)
+        {
+            x0 = llround(x);
+            y0 = llround(y);
+            code0 = Outcode::compute(x0, y0, width, height);
+        }
+        else
+        {
+            x1 = llround(x);
+            y1 = llround(y);
+            code1 = Outcode::compute(x1, y1, width, height);
+        }
+    }
+}
+
+/**
+ * Adds a 2D Natural frame to the buffer, helps with debugging
+*/
+void RoshellGraphics::add_natural_frame()
+{
+    RasterizeTimer timer(*this);
+
+    Point pl, pr, pt, pb;
+
+    pl = Point(-view_width_ / 2, 0);
+    pr = Point(view_width_ / 2, 0);
+    pt = Point(0, view_height_ / 2);
+    pb = Point(0, -view_height_ / 2);
+
+    add_line(pl, pr);
+    add_line(pt, pb);
+}
+
+/**
+ * Adds text to the buffer, one UTF-8 character per cell
+ * 
+ * TODO(deepak): Fix issue where space becomes a '.' because of density
+*/
+void RoshellGraphics::add_text(const Point& start_point, const std::string& text, bool horizontal)
+{
+    RasterizeTimer timer(*this);
+
+    Point curr_point = start_point;
+    transform_to_screen_frame(curr_point);
+
+    // Ignore if starting position is off screen
+    if (!is_within_limits_(curr_point))
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < text.size();)
+    {
+        size_t len = GlyphTable::get_sequence_len(&text[i], text.size() - i);
+        int idx = encode_point_(curr_point);
+        fill_glyph_(idx, glyphs_.intern(&text[i], len));
+        i += len;
+        
+        if (horizontal) // iterate over cols
+        {
+            curr_point(0)++;
+        }
+        else            // iterate over rows
+        {
+            curr_point(1)++;
+        }
+
+        // Stop as soon as out of limits
+        if (!is_within_limits_(curr_point))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Converts point from natural reference frame to the screen reference frame
+ * 
+ * x_screen = x_natural + viewport.x + viewport.width / 2
+ * y_screen = -y_natural + viewport.y + viewport.height / 2
+*/
+void RoshellGraphics::transform_to_screen_frame(Point& p)
+{
+    p(0) = p(0) + view_x_ + static_cast<int>(view_width_ / 2);
+    p(1) = -p(1) + view_y_ + static_cast<int>(view_height_ / 2);
+}
+
+/**
+ * Encode (col, row) into an index location
+*/
+int RoshellGraphics::encode_point_(const Point& p)
+{
+    return p(1) * term_width_ + p(0);
+}
+
+
+/**
+ * Decode encoded point into a Point
+*/
+Point RoshellGraphics::decode_index_(const int& index)
+{
+    return Point(static_cast<int>(index % term_width_), static_cast<int>(index / term_width_));
+}
+
+
+/**
+ * Draw the buffer, and time the stages of the frame if the stats are enabled
+*/
+void RoshellGraphics::draw()
+{
+    bool stats_enabled = stats_->is_enabled();
+    StatsClock::time_point encode_start;
+    if (stats_enabled)
+    {
+        encode_start = StatsClock::now();
+        if (stats_overlay_)
+        {
+            add_stats_overlay_();
+        }
+    }
+
+    size_t len = encode_frame_();
+
+    StatsClock::time_point encode_end;
+    if (stats_enabled)
+    {
+        encode_end = StatsClock::now();
+        stats_->record(FRAME_STAGE_ENCODE,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(encode_end - encode_start).count());
+        stats_->trace(FRAME_STAGE_ENCODE, encode_start, encode_end, len);
+    }
+
+    // Stream buffer to the terminal, the writer thread times the write itself
+    if (writer_)
+    {
+        // The writer thread takes one buffer, so the pieces are moved together
+        size_t offset = 0;
+        for (size_t k = 0; k < out_iov_.size(); k++)
+        {
+            if (out_iov_[k].iov_base != out_buffer_.data() + offset)
+            {
+                memmove(out_buffer_.data() + offset, out_iov_[k].iov_base, out_iov_[k].iov_len);
+            }
+            offset += out_iov_[k].iov_len;
+        }
+        writer_->submit(out_buffer_, len);
+    }
+    else
+    {
+        // Anything printed before must reach the terminal first
+        std::cout.flush();
+        sink_->writev(out_iov_.data(), out_iov_.size());
+
+        if (stats_enabled)
+        {
+            StatsClock::time_point write_end = StatsClock::now();
+            stats_->record(FRAME_STAGE_WRITE,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(write_end - encode_end).count());
+            stats_->trace(FRAME_STAGE_WRITE, encode_end, write_end, len);
+        }
+    }
+
+    // Projecting happens within the rasterization calls, so it is taken out
+    if (stats_enabled)
+    {
+        stats_->record(FRAME_STAGE_PROJECT, project_ns_);
+        stats_->record(FRAME_STAGE_RASTERIZE, rasterize_ns_ > project_ns_ ? rasterize_ns_ - project_ns_ : 0);
+        stats_->record_frame(len, StatsClock::now());
+    }
+    project_ns_ = 0;
+    rasterize_ns_ = 0;
+}
+
+// Worst case for one cell is a cursor move, two colors and a glyph
+static const int max_cell_len = 64;
+
+/**
+ * Encodes the buffer into out_iov_, pieces of out_buffer_, and returns the
+ * length of the frame
+ * 
+ * The buffer is compared against the front buffer, which holds what was
+ * written to the terminal by the previous call. Only the runs of cells that
+ * changed are written, each run starting with a cursor positioning escape.
+ * 
+ * The terminal keeps the current color until it is changed, so a color
+ * sequence is only written when the color, as quantized for the color depth,
+ * differs from the previous cell that was written. The attributes are reset
+ * once at the end.
+ * 
+ * Large frames are encoded in bands of rows on the thread pool, see
+ * encode_bands_(), which gives the same bytes.
+ * 
+ * Images sent with the image protocol are written after the cells, over them.
+ * Kitty images of the previous frame that were not sent again are deleted.
+*/
+size_t RoshellGraphics::encode_frame_()
+{
+    // Below this many cells per thread, waking the threads up costs more than
+    // the encoding they take over
+    static const int min_band_cells = 8192;
+
+    int buffer_len = term_height_ * term_width_;
+
+    // If the writer thread has not picked up the previous frame yet, this frame
+    // replaces it. The front buffer already includes the replaced frame, so all
+    // cells have to be written for the screen to end up correct.
+    bool full_redraw = !front_valid_ || (writer_ && writer_->has_pending());
+
+    if (full_redraw)
+    {
+        front_buffer_.resize(buffer_len);
+    }
+
+    // The deletes are only kept until the frame is encoded. A replaced frame
+    // may have had some, so a full redraw deletes every id that was sent.
+    size_t images_len = image_bytes_.size();
+    int last_id = full_redraw ? kitty_images_sent_ : kitty_images_shown_;
+    for (int id = kitty_images_ + 1; id <= last_id; id++)
+    {
+        ImageProtocolEncoder::encode_kitty_delete(id, image_bytes_);
+    }
+    kitty_images_shown_ = kitty_images_;
+    kitty_images_sent_ = std::max(kitty_images_sent_, kitty_images_);
+
+    // The screen no longer shows what the front buffer has under sixel images
+    // that are not drawn again
+    if (!full_redraw)
+    {
+        for (size_t k = 0; k < sixel_images_shown_.size(); k++)
+        {
+            const ProtocolImage& shown = sixel_images_shown_[k];
+            bool redrawn = false;
+            for (size_t j = 0; j < images_.size() && !redrawn; j++)
+            {
+                redrawn = (images_[j].sixel && images_[j].index == shown.index && images_[j].cols == shown.cols &&
+                    images_[j].rows == shown.rows);
+            }
+
+            for (int r = 0; r < shown.rows && !redrawn; r++)
+            {
+                for (int c = 0; c < shown.cols; c++)
+                {
+                    front_buffer_[shown.index + r * term_width_ + c].glyph = GLYPH_NONE;
+                }
+            }
+        }
+    }
+
+    // Only allocates when the terminal grew or the images did. The cells of
+    // each band start at the worst case end of the previous ones.
+    size_t max_len = static_cast<size_t>(buffer_len + 1 + images_.size()) * max_cell_len + image_bytes_.size();
+    if (out_buffer_.size() < max_len)
+    {
+        out_buffer_.resize(max_len);
+    }
+    out_iov_.clear();
+
+    // The previous frame ended with a reset
+    EncodeState state = {false, 0, false, 0};
+    char* out = out_buffer_.data();
+
+    int num_bands = pool_ ? std::min(pool_->size(), buffer_len / min_band_cells) : 1;
+    if (num_bands > 1)
+    {
+        encode_bands_(num_bands, full_redraw, state);
+        out += static_cast<size_t>(buffer_len) * max_cell_len;
+    }
+    else
+    {
+        int first_written = -1;
+        out = encode_cells_(0, buffer_len, full_redraw, state, first_written, out);
+        append_iov_(out_buffer_.data(), out - out_buffer_.data());
+    }
+
+    front_valid_ = true;
+
+    char* tail = out;
+
+    sixel_images_shown_.clear();
+    for (size_t k = 0; k < images_.size(); k++)
+    {
+        const ProtocolImage& image = images_[k];
+        size_t end = (k + 1 < images_.size()) ? images_[k + 1].start : images_len;
+        out = write_cursor_escape_(out, image.index);
+        memcpy(out, image_bytes_.data() + image.start, end - image.start);
+        out += end - image.start;
+
+        if (image.sixel)
+        {
+            sixel_images_shown_.push_back(image);
+        }
+    }
+    memcpy(out, image_bytes_.data() + images_len, image_bytes_.size() - images_len);
+    out += image_bytes_.size() - images_len;
+    image_bytes_.resize(images_len);
+
+    if (state.color_set)
+    {
+        memcpy(out, "\033[0m", 4);
+        out += 4;
+    }
+
+    // Joins the cells if they were encoded in one go
+    append_iov_(tail, out - tail);
+
+    size_t len = 0;
+    for (size_t k = 0; k < out_iov_.size(); k++)
+    {
+        len += out_iov_[k].iov_len;
+    }
+    return len;
+}
+
+/**
+ * Encodes the cells [begin, end) to out and returns the new end. state holds
+ * the colors the terminal is left with, on entry and on return. first_written
+ * is set to the first cell written, if it is -1 on entry.
+*/
+char* RoshellGraphics::encode_cells_(int begin, int end, bool full_redraw, EncodeState& state,
+    int& first_written, char* out)
+{
+    static const unsigned char white[3] = {255, 255, 255};
+    static const Cell empty_cell = Cell();
+    const GlyphId blank_glyph = count_to_glyph_map_[0];
+    const GlyphSpan* glyph_spans = glyphs_.get_spans();
+    const int max_count = count_to_glyph_map_.size() - 1;
+    const std::vector<EscapeSequence>& colormap_escapes = colormap_escapes_(color_depth_);
+
+    int run_end = -1;   // One past the last cell that was written
+    bool color_set = state.color_set;
+    uint32_t current_color = state.current_color;
+    bool bg_set = state.bg_set;
+    uint32_t current_bg = state.current_bg;
+    for (int i = begin; i < end; i++)
+    {
+        Cell& front = front_buffer_[i];
+
+        // A stale cell reads as blank, there is nothing to write if the screen
+        // shows it blank already
+        bool stale = (buffer_[i].generation != generation_);
+        if (stale && !full_redraw && front.glyph == blank_glyph && !front.has_bg &&
+            memcmp(front.color, white, 3) == 0)
+        {
+            continue;
+        }
+
+        const Cell& cell = stale ? empty_cell : buffer_[i];
+
+        // If the glyph was not set, it is picked by the dots or the density
+        GlyphId glyph = cell.glyph;
+        if (glyph == GLYPH_NONE)
+        {
+            glyph = (cell.dots != 0) ? dots_to_glyph_map_[cell.dots] :
+                count_to_glyph_map_[std::min<int>(cell.count, max_count)];
+        }
+        const unsigned char* color = (cell.color_type != CELL_COLOR_NONE) ? cell.color : white;
+
+        if (!full_redraw && glyph == front.glyph && memcmp(color, front.color, 3) == 0 &&
+            cell.has_bg == front.has_bg && (!cell.has_bg || memcmp(cell.bg_color, front.bg_color, 3) == 0))
+        {
+            continue;
+        }
+
+        // Start a new run at the beginning of each row or after skipped cells
+        if (i != run_end || i % term_width_ == 0)
+        {
+            out = write_cursor_escape_(out, i);
+            if (first_written < 0)
+            {
+                first_written = i;
+            }
+        }
+
+        uint32_t color_key = color_key_(color);
+        if (!color_set || color_key != current_color)
+        {
+            if (cell.color_type == CELL_COLOR_MAP)
+            {
+                const EscapeSequence& escape = colormap_escapes[cell.colormap_idx];
+                memcpy(out, escape.bytes, escape.len);
+                out += escape.len;
+            }
+            else
+            {
+                out = write_color_escape_(out, color, color_depth_);
+            }
+            current_color = color_key;
+            color_set = true;
+        }
+
+        if (cell.has_bg)
+        {
+            uint32_t bg_key = color_key_(cell.bg_color);
+            if (!bg_set || bg_key != current_bg)
+            {
+                out = write_color_escape_(out, cell.bg_color, color_depth_, true);
+                current_bg = bg_key;
+                bg_set = true;
+            }
+        }
+        else if (bg_set)    // Back to the default background
+        {
+            memcpy(out, "\033[49m", 5);
+            out += 5;
+            bg_set = false;
+        }
+
+        // All the bytes are copied at once, the ones past len are overwritten
+        const GlyphSpan& span = glyph_spans[glyph];
+        memcpy(out, span.bytes, GLYPH_MAX_LEN);
+        out += span.len;
+        run_end = i + 1;
+
+        front.glyph = glyph;
+        memcpy(front.color, color, 3);
+        memcpy(front.bg_color, cell.bg_color, 3);
+        front.has_bg = cell.has_bg;
+    }
+
+    state.color_set = color_set;
+    state.current_color = current_color;
+    state.bg_set = bg_set;
+    state.current_bg = current_bg;
+    return out;
+}
+
+/**
+ * Encodes the cells in num_bands bands of rows, one per thread of the pool,
+ * and appends them to out_iov_. state is the colors the terminal is left with,
+ * on entry and on return.
+ * 
+ * A band does not know the colors the previous one ends with, so it starts as
+ * if they were unknown, and writes both colors of its first cell. Once all
+ * bands are done, the ones the serial encoding would not have written are
+ * left out of out_iov_, which gives the same bytes as encoding all cells in
+ * one go.
+*/
+void RoshellGraphics::encode_bands_(const int& num_bands, const bool& full_redraw, EncodeState& state)
+{
+    // No color has this key, so the first cell writes its colors
+    static const EncodeState unknown_state = {true, UINT32_MAX, true, UINT32_MAX};
+
+    int rows_per_band = (term_height_ + num_bands - 1) / num_bands;
+    bands_.resize(num_bands);
+
+    // Threads past the last band have nothing to do
+    pool_->run([&](int k)
+    {
+        if (k >= num_bands)
+        {
+            return;
+        }
+
+        int begin = std::min(k * rows_per_band, term_height_) * term_width_;
+        int end = std::min((k + 1) * rows_per_band, term_height_) * term_width_;
+
+        EncodeBand& band = bands_[k];
+        band.state = unknown_state;
+        band.first_written = -1;
+        band.begin = out_buffer_.data() + static_cast<size_t>(begin) * max_cell_len;
+        band.end = encode_cells_(begin, end, full_redraw, band.state, band.first_written, band.begin);
+    });
+
+    for (int k = 0; k < num_bands; k++)
+    {
+        const EncodeBand& band = bands_[k];
+        if (band.first_written < 0)     // The colors carry over
+        {
+            continue;
+        }
+
+        // Bands start with the cursor escape of the first cell, then its color
+        // and its background or "\033[49m"
+        const Cell& first = front_buffer_[band.first_written];
+        char escape[max_cell_len];
+        size_t cursor_len = write_cursor_escape_(escape, band.first_written) - escape;
+        size_t color_len = write_color_escape_(escape, first.color, color_depth_) - escape;
+        size_t bg_len = first.has_bg ? write_color_escape_(escape, first.bg_color, color_depth_, true) - escape : 5;
+
+        bool same_color = state.color_set && color_key_(first.color) == state.current_color;
+        bool same_bg = first.has_bg ? (state.bg_set && color_key_(first.bg_color) == state.current_bg) : !state.bg_set;
+
+        char* out = band.begin;
+        append_iov_(out, cursor_len);
+        out += cursor_len;
+        if (!same_color)
+        {
+            append_iov_(out, color_len);
+        }
+        out += color_len;
+        if (!same_bg)
+        {
+            append_iov_(out, bg_len);
+        }
+        out += bg_len;
+        append_iov_(out, band.end - out);
+
+        state = band.state;
+    }
+}
+
+/**
+ * Appends len bytes at data to out_iov_, extending the last piece if it ends
+ * at data
+*/
+void RoshellGraphics::append_iov_(char* data, const size_t& len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (!out_iov_.empty())
+    {
+        struct iovec& last = out_iov_.back();
+        if (static_cast<char*>(last.iov_base) + last.iov_len == data)
+        {
+            last.iov_len += len;
+            return;
+        }
+    }
+
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = len;
+    out_iov_.push_back(iov);
+}
+
+/**
+ * Writes the stats of the last frame over the top row of the terminal, in
+ * white on the default background
+*/
+void RoshellGraphics::add_stats_overlay_()
+{
+    std::string summary = stats_->get_summary();
+    int col = 0;
+    for (size_t i = 0; i < summary.size() && col < term_width_; col++)
+    {
+        size_t len = GlyphTable::get_sequence_len(&summary[i], summary.size() - i);
+        claim_cell_(col);
+        fill_glyph_(col, glyphs_.intern(&summary[i], len));
+        i += len;
+    }
+}
+
+/**
+ * Forces the next call to draw() to write every cell, e.g. after something
+ * else has written to the terminal
+*/
+void RoshellGraphics::force_redraw()
+{
+    front_valid_ = false;
+}
+
+/**
+ * When set, draw() hands frames over to a writer thread instead of blocking
+ * until the terminal has consumed them
+*/
+void RoshellGraphics::set_async_output(bool async_output)
+{
+    if (async_output && !writer_)
+    {
+        // Anything printed before must reach the terminal first
+        std::cout.flush();
+        writer_ = std::make_shared<TerminalWriter>(sink_, stats_);
+    }
+    else if (!async_output)
+    {
+        // Waits for the last frame to be written
+        writer_.reset();
+    }
+}
+
+/**
+ * Returns the number of frames written to the sink by the writer thread
+*/
+uint64_t RoshellGraphics::get_frames_written()
+{
+    return writer_ ? writer_->get_frames_written() : 0;
+}
+
+/**
+ * Returns the number of frames the writer thread dropped because a newer
+ * frame arrived before it could write them
+*/
+uint64_t RoshellGraphics::get_frames_superseded()
+{
+    return writer_ ? writer_->get_frames_superseded() : 0;
+}
+
+/**
+ * Sets how many threads bin points and encode frames, including the calling
+ * one. Clouds and frames that are too small to benefit are still handled on
+ * the calling thread.
+*/
+void RoshellGraphics::set_num_threads(const int& num_threads)
+{
+    if (num_threads <= 1)
+    {
+        pool_.reset();
+    }
+    else if (!pool_ || pool_->size() != num_threads)
+    {
+        pool_ = std::make_shared<ThreadPool>(num_threads);
+    }
+}
+
+/**
+ * Returns how many threads bin points and encode frames
+*/
+int RoshellGraphics::get_num_threads()
+{
+    return pool_ ? pool_->size() : 1;
+}
+
+/**
+ * Starts or stops timing the stages of every frame. Off by default, when off
+ * the only cost is a flag check per call.
+*/
+void RoshellGraphics::set_stats_enabled(const bool& enabled)
+{
+    stats_->set_enabled(enabled);
+}
+
+/**
+ * Shows the stats of the last frame on the top row of every frame, which
+ * also enables them. The row is drawn over whatever is below it.
+*/
+void RoshellGraphics::set_stats_overlay(const bool& stats_overlay)
+{
+    stats_overlay_ = stats_overlay;
+    if (stats_overlay_)
+    {
+        stats_->set_enabled(true);
+    }
+}
+
+/**
+ * Returns the stats, e.g. to publish them, time the ingest of the messages
+ * or keep a trace. They stay valid after this object is destroyed.
+*/
+std::shared_ptr<FrameStats> RoshellGraphics::get_frame_stats()
+{
+    return stats_;
+}
+
+/**
+ * Draw and clear. Only the cells that changed since the last frame are written
+*/
+void RoshellGraphics::draw_and_clear(unsigned long delay)
+{
+    draw();
+    usleep(delay);
+    clear_buffer();
+}
+
+/**
+ * Returns the current terminal size as a pair (width, height)
+*/
+std::pair<int, int> RoshellGraphics::get_terminal_size()
+{
+    return std::make_pair(term_width_, term_height_);
+}
+
+/**
+ * Draws to viewport from now on, clipped to the terminal. Cells outside of it
+ * are left alone, so panes drawn one after the other end up in the same frame.
+*/
+void RoshellGraphics::set_viewport(const Viewport& viewport)
+{
+    int x0 = std::max(0, std::min(viewport.x, term_width_));
+    int y0 = std::max(0, std::min(viewport.y, term_height_));
+    int x1 = std::max(x0, std::min(viewport.x + std::max(viewport.width, 0), term_width_));
+    int y1 = std::max(y0, std::min(viewport.y + std::max(viewport.height, 0), term_height_));
+
+    view_x_ = x0;
+    view_y_ = y0;
+    view_width_ = x1 - x0;
+    view_height_ = y1 - y0;
+}
+
+/**
+ * Draws to the whole terminal from now on
+*/
+void RoshellGraphics::reset_viewport()
+{
+    view_x_ = 0;
+    view_y_ = 0;
+    view_width_ = term_width_;
+    view_height_ = term_height_;
+}
+
+/**
+ * Returns the viewport, within the terminal
+*/
+Viewport RoshellGraphics::get_viewport()
+{
+    Viewport viewport = {view_x_, view_y_, view_width_, view_height_};
+    return viewport;
+}
+
+/**
+ * Returns true if point is within the viewport, else returns false. Point must be in Screen frame
+*/
+bool RoshellGraphics::is_within_limits_(const Point& p)
+{
+    return p(0) >= view_x_ && p(0) < view_x_ + view_width_ && p(1) >= view_y_ && p(1) < view_y_ + view_height_;
+}
+
+/**
+ * Adds image to the buffer. Resizes im to the correct size depending on the size of the viewport
+ * and whether preserve_aspect is set to true or false
+*/
+void RoshellGraphics::add_image(const cv::Mat& im, bool preserve_aspect)
+{
+    RasterizeTimer timer(*this);
+
+    if (image_protocol_ != IMAGE_PROTOCOL_CELLS && add_protocol_image_(im, preserve_aspect))
+    {
+        return;
+    }
+
+    if (image_mode_ == IMAGE_MODE_HALF_BLOCK)
+    {
+        add_half_block_image_(im, preserve_aspect);
+        return;
+    }
+
+    cv::Size new_size;
+
+    if (preserve_aspect)
+    {
+        double s = std::min((double) view_height_ / im.rows, 
+            (double) view_width_ / im.cols);
+        new_size = cv::Size(2 * im.cols * s, im.rows * s);
+    }
+    else // fullscreen
+    {
+        new_size = cv::Size(view_width_, view_height_);
+    }
+
+    if (new_size.width <= 0 || new_size.height <= 0)
+    {
+        return;
+    }
+
+    cv::resize(im, image_resized_, new_size);
+
+    bool dither = dithering_ && color_depth_ != COLOR_DEPTH_TRUECOLOR;
+
+    for (int r = 0; r < image_resized_.rows; r++)
+    {
+        for (int c = 0; c < image_resized_.cols; c++)
+        {                       
+            cv::Vec3b pixel = image_resized_.at<cv::Vec3b>(r, c);  /* cv::Mat is indexed (row, col) */
+            Point p(view_x_ + c, view_y_ + r);                    /* Point takes in (col, row) */
+
+            if (is_within_limits_(p))
+            {
+                unsigned char color[3] = {pixel[2], pixel[1], pixel[0]};  /* BGR -> RGB */
+                if (dither)
+                {
+                    dither_(color, c, r);
+                }
+
+                int idx = encode_point_(p);
+                fill_glyph_(idx, block_glyph_);
+                fill_color(idx, color);
+            }
+        }
+    }
+}
+
+/**
+ * Returns a key that is equal for two colors if and only if they are written
+ * as the same escape sequence at the current color depth
+*/
+uint32_t RoshellGraphics::color_key_(const unsigned char* color)
+{
+    switch (color_depth_)
+    {
+        case COLOR_DEPTH_256:
+            return Palette::rgb_to_256(color);
+        case COLOR_DEPTH_16:
+            return Palette::rgb_to_16(color);
+        default:
+            return (color[0] << 16) | (color[1] << 8) | color[2];
+    }
+}
+
+/**
+ * Sets which color escape sequences are written. The default is picked from
+ * the TERM and COLORTERM environment variables.
+*/
+void RoshellGraphics::set_color_depth(const ColorDepth& color_depth)
+{
+    if (color_depth != color_depth_)
+    {
+        color_depth_ = color_depth;
+        force_redraw();
+    }
+}
+
+/**
+ * Returns which color escape sequences are written
+*/
+ColorDepth RoshellGraphics::get_color_depth()
+{
+    return color_depth_;
+}
+
+/**
+ * When set, add_image() applies ordered dithering to the pixels if the color
+ * depth is lower than truecolor, which hides the banding of the palette
+*/
+void RoshellGraphics::set_dithering(bool dithering)
+{
+    dithering_ = dithering;
+}
+
+/**
+ * Adds a 4x4 Bayer threshold to color, scaled to the spacing of the palette.
+ * (x, y) is the position of the pixel, which picks the threshold.
+*/
+void RoshellGraphics::dither_(unsigned char* color, const int& x, const int& y)
+{
+    static const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+    // Approximate distance between neighbouring palette colors
+    int spacing = (color_depth_ == COLOR_DEPTH_256) ? 40 : 128;
+    int offset = (2 * bayer[y & 3][x & 3] + 1 - 16) * spacing / 32;
+
+    for (int c = 0; c < 3; c++)
+    {
+        color[c] = std::max(0, std::min(255, color[c] + offset));
+    }
+}
+
+/**
+ * Sets how images are put into cells. IMAGE_MODE_HALF_BLOCK draws two pixels
+ * per cell with '▀', the top one as the foreground and the bottom one as the
+ * background color, doubling the vertical resolution.
+*/
+void RoshellGraphics::set_image_mode(const ImageMode& image_mode)
+{
+    image_mode_ = image_mode;
+}
+
+/**
+ * Adds image to the buffer, two rows of pixels per cell. Since a cell is about
+ * twice as high as it is wide, the pixels are square and the image is resized
+ * to fit a grid of view_width_ x (2 * view_height_) pixels.
+*/
+void RoshellGraphics::add_half_block_image_(const cv::Mat& im, bool preserve_aspect)
+{
+    cv::Size new_size;
+
+    if (preserve_aspect)
+    {
+        double s = std::min((double) 2 * view_height_ / im.rows, 
+            (double) view_width_ / im.cols);
+        new_size = cv::Size(std::min<int>(im.cols * s, view_width_),
+            std::min<int>(im.rows * s, 2 * view_height_));
+    }
+    else // fullscreen
+    {
+        new_size = cv::Size(view_width_, 2 * view_height_);
+    }
+
+    if (new_size.width <= 0 || new_size.height <= 0)
+    {
+        return;
+    }
+
+    cv::resize(im, image_resized_, new_size);
+
+    bool dither = dithering_ && color_depth_ != COLOR_DEPTH_TRUECOLOR;
+
+    for (int r = 0; r < image_resized_.rows; r += 2)
+    {
+        const cv::Vec3b* top_row = image_resized_.ptr<cv::Vec3b>(r);
+        const cv::Vec3b* bottom_row = (r + 1 < image_resized_.rows) ? image_resized_.ptr<cv::Vec3b>(r + 1) : nullptr;
+
+        for (int c = 0; c < image_resized_.cols; c++)
+        {
+            int idx = encode_point_(Point(view_x_ + c, view_y_ + r / 2));
+
+            unsigned char top[3] = {top_row[c][2], top_row[c][1], top_row[c][0]};  /* BGR -> RGB */
+            if (dither)
+            {
+                dither_(top, c, r);
+            }
+            fill_glyph_(idx, half_block_glyph_);
+            fill_color(idx, top);
+
+            // An odd number of rows leaves the last bottom half empty
+            if (bottom_row)
+            {
+                unsigned char bottom[3] = {bottom_row[c][2], bottom_row[c][1], bottom_row[c][0]};
+                if (dither)
+                {
+                    dither_(bottom, c, r + 1);
+                }
+                fill_bg_color_(idx, bottom);
+            }
+        }
+    }
+}
+
+/**
+ * Sets how add_image() sends images. Anything but IMAGE_PROTOCOL_CELLS sends
+ * the pixels with a terminal graphics protocol, which only works if the
+ * terminal supports it, see ImageProtocolEncoder::detect().
+*/
+void RoshellGraphics::set_image_protocol(const ImageProtocol& image_protocol)
+{
+    image_protocol_ = image_protocol;
+}
+
+/**
+ * Returns how add_image() sends images
+*/
+ImageProtocol RoshellGraphics::get_image_protocol()
+{
+    return image_protocol_;
+}
+
+/**
+ * Adds image as pixels sent with the image protocol, at the top left corner of
+ * the viewport and in as many cells as add_image() would fill. Kitty scales the
+ * pixels to the cells, so they are never sent larger than the image is. Sixel
+ * pixels are drawn as they are, and are kept off the last row of the terminal,
+ * which would scroll. Returns false if the image does not fit, it then goes
+ * into cells.
+*/
+bool RoshellGraphics::add_protocol_image_(const cv::Mat& im, bool preserve_aspect)
+{
+    bool sixel = (image_protocol_ == IMAGE_PROTOCOL_SIXEL);
+    int view_height = sixel ? std::min(view_height_, term_height_ - 1 - view_y_) : view_height_;
+    if (im.empty() || view_width_ <= 0 || view_height <= 0)
+    {
+        return false;
+    }
+
+    // Size in pixels and in cells
+    int width, height, cols, rows;
+    if (preserve_aspect)
+    {
+        double s = std::min((double) view_width_ * cell_pixel_width_ / im.cols,
+            (double) view_height * cell_pixel_height_ / im.rows);
+        width = std::max(1, static_cast<int>(im.cols * s));
+        height = std::max(1, static_cast<int>(im.rows * s));
+        cols = std::min(view_width_, (width + cell_pixel_width_ - 1) / cell_pixel_width_);
+        rows = std::min(view_height, (height + cell_pixel_height_ - 1) / cell_pixel_height_);
+    }
+    else // fullscreen
+    {
+        cols = view_width_;
+        rows = view_height;
+        width = cols * cell_pixel_width_;
+        height = rows * cell_pixel_height_;
+    }
+
+    if (!sixel)
+    {
+        width = std::min(width, im.cols);
+        height = std::min(height, im.rows);
+    }
+
+    const cv::Mat* pixels = &im;
+    if (width != im.cols || height != im.rows)
+    {
+        cv::resize(im, image_resized_, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        pixels = &image_resized_;
+    }
+
+    ProtocolImage image = {encode_point_(Point(view_x_, view_y_)), cols, rows, image_bytes_.size(), sixel};
+    images_.push_back(image);
+
+    if (image_protocol_ == IMAGE_PROTOCOL_KITTY_PNG)
+    {
+        // PNG takes BGR as it is
+        cv::imencode(".png", *pixels, image_png_);
+        ImageProtocolEncoder::encode_kitty_png(image_png_, cols, rows, ++kitty_images_, image_bytes_);
+    }
+    else
+    {
+        image_pixels_.resize(static_cast<size_t>(width) * height * 3);
+        unsigned char* rgb = image_pixels_.data();
+        for (int r = 0; r < height; r++)
+        {
+            const cv::Vec3b* row = pixels->ptr<cv::Vec3b>(r);
+            for (int c = 0; c < width; c++)
+            {
+                /* BGR -> RGB */
+                *rgb++ = row[c][2];
+                *rgb++ = row[c][1];
+                *rgb++ = row[c][0];
+            }
+        }
+
+        if (sixel)
+        {
+            ImageProtocolEncoder::encode_sixel(image_pixels_.data(), width, height, image_bytes_);
+        }
+        else
+        {
+            ImageProtocolEncoder::encode_kitty(image_pixels_.data(), width, height, cols, rows,
+                ++kitty_images_, image_bytes_);
+        }
+    }
+
+    return true;
+}
+
+}  // namespace roshell_graphics
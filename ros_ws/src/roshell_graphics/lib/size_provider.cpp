@@ -0,0 +1,142 @@
+#include <roshell_graphics/size_provider.h>
+
+#include <string.h>
+#include <sys/ioctl.h>
+
+namespace roshell_graphics
+{
+
+std::atomic<unsigned int> TerminalSizeProvider::resize_generation_(0);
+struct sigaction TerminalSizeProvider::previous_action_;
+std::once_flag TerminalSizeProvider::handler_installed_;
+
+/**
+ * Constructor, installs the SIGWINCH handler if it is not there yet
+*/
+TerminalSizeProvider::TerminalSizeProvider(int fd):
+    fd_(fd),
+    queried_(false),
+    seen_generation_(0)
+{
+    std::call_once(handler_installed_, &TerminalSizeProvider::install_handler_);
+}
+
+/**
+ * Asks the terminal for its size
+*/
+bool TerminalSizeProvider::get_size(int& width, int& height)
+{
+    // Read first, so a resize during the ioctl is seen by the next call
+    seen_generation_ = resize_generation_;
+    queried_ = true;
+
+    struct winsize w;
+    if (ioctl(fd_, TIOCGWINSZ, &w) != 0 || w.ws_row == 0 || w.ws_col == 0)
+    {
+        return false;
+    }
+
+    width = w.ws_col;
+    height = w.ws_row;
+    return true;
+}
+
+/**
+ * Returns true if a SIGWINCH arrived since the last get_size()
+*/
+bool TerminalSizeProvider::has_changed()
+{
+    return !queried_ || resize_generation_ != seen_generation_;
+}
+
+/**
+ * Asks the terminal for the size of a cell in pixels, which not all terminals
+ * report
+*/
+bool TerminalSizeProvider::get_cell_pixel_size(int& width, int& height)
+{
+    struct winsize w;
+    if (ioctl(fd_, TIOCGWINSZ, &w) != 0 || w.ws_row == 0 || w.ws_col == 0 || w.ws_xpixel == 0 || w.ws_ypixel == 0)
+    {
+        return false;
+    }
+
+    width = w.ws_xpixel / w.ws_col;
+    height = w.ws_ypixel / w.ws_row;
+    return width > 0 && height > 0;
+}
+
+/**
+ * Sets on_resize_() as the SIGWINCH handler, keeping the previous one
+*/
+void TerminalSizeProvider::install_handler_()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &TerminalSizeProvider::on_resize_;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigaction(SIGWINCH, &action, &previous_action_);
+}
+
+/**
+ * SIGWINCH handler, only does async-signal-safe work. The previous handler
+ * gets the signal information too if it was installed with SA_SIGINFO.
+*/
+void TerminalSizeProvider::on_resize_(int signal, siginfo_t* info, void* context)
+{
+    resize_generation_++;
+
+    if (previous_action_.sa_flags & SA_SIGINFO)
+    {
+        if (previous_action_.sa_sigaction)
+        {
+            previous_action_.sa_sigaction(signal, info, context);
+        }
+    }
+    else if (previous_action_.sa_handler != SIG_DFL && previous_action_.sa_handler != SIG_IGN)
+    {
+        previous_action_.sa_handler(signal);
+    }
+}
+
+/**
+ * Constructor
+*/
+FixedSizeProvider::FixedSizeProvider(const int& width, const int& height):
+    width_(width),
+    height_(height),
+    changed_(true)
+{
+}
+
+/**
+ * Returns the size that was set
+*/
+bool FixedSizeProvider::get_size(int& width, int& height)
+{
+    changed_ = false;
+    width = width_;
+    height = height_;
+    return true;
+}
+
+/**
+ * Returns true if set_size() was called since the last get_size()
+*/
+bool FixedSizeProvider::has_changed()
+{
+    return changed_;
+}
+
+/**
+ * Changes the size
+*/
+void FixedSizeProvider::set_size(const int& width, const int& height)
+{
+    width_ = width;
+    height_ = height;
+    changed_ = true;
+}
+
+}  // namespace roshell_graphics
@@ -0,0 +1,44 @@
+#include <roshell_graphics/stats_publisher.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, starts publishing rate times per second. The stats are enabled,
+ * there would be nothing to publish otherwise.
+*/
+StatsPublisher::StatsPublisher(ros::NodeHandle& nh, const std::shared_ptr<FrameStats>& stats, const double& rate):
+    stats_(stats),
+    name_(ros::this_node::getName() + ": frame stats")
+{
+    stats_->set_enabled(true);
+
+    diagnostics_pub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    timer_ = nh.createTimer(ros::Duration(1.0 / rate), &StatsPublisher::publish_, this);
+}
+
+/**
+ * Timer callback, publishes the stats collected so far
+*/
+void StatsPublisher::publish_(const ros::TimerEvent& /*event*/)
+{
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = name_;
+    status.message = stats_->get_summary();
+
+    std::vector<std::pair<std::string, std::string>> values = stats_->get_values();
+    status.values.resize(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        status.values[i].key = values[i].first;
+        status.values[i].value = values[i].second;
+    }
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    diagnostics_pub_.publish(diagnostics);
+}
+
+}  // namespace roshell_graphics
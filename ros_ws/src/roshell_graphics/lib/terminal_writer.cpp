@@ -0,0 +1,118 @@
+#include <roshell_graphics/terminal_writer.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, starts the writer thread
+*/
+TerminalWriter::TerminalWriter(const std::shared_ptr<OutputSink>& sink,
+    const std::shared_ptr<FrameStats>& stats):
+    sink_(sink),
+    stats_(stats),
+    pending_len_(0),
+    has_pending_(false),
+    stop_(false),
+    frames_written_(0),
+    frames_superseded_(0)
+{
+    thread_ = std::thread(&TerminalWriter::run_, this);
+}
+
+/**
+ * Destructor, writes the pending frame and stops the writer thread
+*/
+TerminalWriter::~TerminalWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+/**
+ * Hands the first len bytes of frame to the writer thread. frame is swapped
+ * with an older buffer, which the caller can reuse for the next frame.
+*/
+void TerminalWriter::submit(std::vector<char>& frame, const size_t& len)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (has_pending_)
+        {
+            frames_superseded_++;
+        }
+
+        pending_.swap(frame);
+        pending_len_ = len;
+        has_pending_ = true;
+    }
+    cv_.notify_one();
+}
+
+/**
+ * Returns true if the last submitted frame is still waiting to be written
+*/
+bool TerminalWriter::has_pending()
+{
+    return has_pending_;
+}
+
+/**
+ * Returns the number of frames written to the sink
+*/
+uint64_t TerminalWriter::get_frames_written()
+{
+    return frames_written_;
+}
+
+/**
+ * Returns the number of frames that were replaced before being written
+*/
+uint64_t TerminalWriter::get_frames_superseded()
+{
+    return frames_superseded_;
+}
+
+/**
+ * Writer thread loop
+*/
+void TerminalWriter::run_()
+{
+    while (true)
+    {
+        size_t len;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return has_pending_ || stop_; });
+
+            if (!has_pending_)  // Stopped and nothing left to write
+            {
+                return;
+            }
+
+            writing_.swap(pending_);
+            len = pending_len_;
+            has_pending_ = false;
+        }
+
+        if (stats_ && stats_->is_enabled())
+        {
+            StatsClock::time_point start = StatsClock::now();
+            sink_->write(writing_.data(), len);
+            StatsClock::time_point end = StatsClock::now();
+            stats_->record(FRAME_STAGE_WRITE,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            stats_->trace(FRAME_STAGE_WRITE, start, end, len);
+        }
+        else
+        {
+            sink_->write(writing_.data(), len);
+        }
+        frames_written_++;
+    }
+}
+
+}  // namespace roshell_graphics
@@ -0,0 +1,98 @@
+#include <roshell_graphics/thread_pool.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Constructor, starts num_threads - 1 workers
+*/
+ThreadPool::ThreadPool(const int& num_threads):
+    job_(NULL),
+    generation_(0),
+    remaining_(0),
+    stop_(false)
+{
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads_.push_back(std::thread(&ThreadPool::worker_, this, i));
+    }
+}
+
+/**
+ * Destructor, stops the workers
+*/
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+
+    for (size_t i = 0; i < threads_.size(); i++)
+    {
+        threads_[i].join();
+    }
+}
+
+/**
+ * Returns the number of threads, including the calling one
+*/
+int ThreadPool::size()
+{
+    return threads_.size() + 1;
+}
+
+/**
+ * Runs job(i) for every thread index i and waits for all of them
+*/
+void ThreadPool::run(const std::function<void(int)>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &job;
+        remaining_ = threads_.size();
+        generation_++;
+    }
+    start_cv_.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this]() { return remaining_ == 0; });
+    job_ = NULL;
+}
+
+/**
+ * Worker loop
+*/
+void ThreadPool::worker_(int index)
+{
+    uint64_t generation = 0;
+    while (true)
+    {
+        const std::function<void(int)>* job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [this, &generation]() { return generation_ != generation || stop_; });
+
+            if (stop_)
+            {
+                return;
+            }
+
+            generation = generation_;
+            job = job_;
+        }
+
+        (*job)(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            remaining_--;
+        }
+        done_cv_.notify_one();
+    }
+}
+
+}  // namespace roshell_graphics
@@ -15,7 +15,8 @@ class FloatVisualizer
         FloatVisualizer(
             const std::string& topic,
             const float& min_val,
-            const float& max_val);
+            const float& max_val,
+            const bool& braille);
         
         ~FloatVisualizer();
 
@@ -35,13 +36,19 @@ class FloatVisualizer
 FloatVisualizer::FloatVisualizer(
     const std::string& topic,
     const float& min_val,
-    const float& max_val):
+    const float& max_val,
+    const bool& braille):
     nh_(),
     min_val_(min_val),
     max_val_(max_val)
 {
     sub_ = nh_.subscribe<std_msgs::Float32>(topic, 10, &FloatVisualizer::callback, this);
     pg_ = std::make_shared<roshell_graphics::PlotGraph>();
+
+    if (braille)
+    {
+        pg_->set_raster_mode(roshell_graphics::RASTER_MODE_BRAILLE);
+    }
 }
 
 FloatVisualizer::~FloatVisualizer()
@@ -70,6 +77,7 @@ int main(int argc, char** argv)
 
     std::string topic = "";
     float max_val, min_val;
+    bool braille;
 
     int bad_params = 0;
 
@@ -83,10 +91,14 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // Optional parameters
+    pnh.param("braille", braille, false);
+
     roshell_graphics::FloatVisualizer fv(
         topic,
         min_val,
-        max_val);
+        max_val,
+        braille);
     
     ros::spin();
     return 0;
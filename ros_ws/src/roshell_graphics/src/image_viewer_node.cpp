@@ -2,10 +2,9 @@
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 
-// Uncomment if we want to measure time
-// #include <chrono>  
-
 #include <roshell_graphics/roshell_graphics.h>
+#include <roshell_graphics/stats_publisher.h>
+#include <roshell_graphics/quality_controller.h>
 
 namespace roshell_graphics
 {
@@ -15,7 +14,18 @@ class ImageViewerNode
   public:
     ImageViewerNode(
         const std::string& in_topic,
-        bool preserve_aspect = true);
+        bool preserve_aspect = true,
+        bool async_output = false,
+        bool half_block = false,
+        bool dithering = false,
+        bool overlay = false,
+        double diagnostics_rate = 0.0,
+        const std::string& trace_file = "",
+        bool adaptive_quality = false,
+        double target_fps = 15.0,
+        double max_bytes_per_second = 0.0,
+        roshell_graphics::ImageProtocol image_protocol = roshell_graphics::IMAGE_PROTOCOL_CELLS,
+        int num_threads = 1);
     ~ImageViewerNode();
 
   private:
@@ -24,39 +34,152 @@ class ImageViewerNode
     std::string in_topic_;
     bool preserve_aspect_;
     image_transport::Subscriber image_sub_;
+
+    // Stage times, published on /diagnostics and dumped to trace_file_ if
+    // they are set
+    std::shared_ptr<roshell_graphics::FrameStats> stats_;
+    std::shared_ptr<roshell_graphics::StatsPublisher> stats_pub_;
+    std::string trace_file_;
+
+    // Only set with adaptive quality, it caps the color depth, the half
+    // blocks and the image protocol that were configured
+    std::shared_ptr<roshell_graphics::QualityController> quality_;
+    roshell_graphics::ColorDepth base_color_depth_ = roshell_graphics::COLOR_DEPTH_TRUECOLOR;
+    bool half_block_ = false;
+    roshell_graphics::ImageProtocol image_protocol_;
+
+    void update_quality_();
     void image_callback(const sensor_msgs::ImageConstPtr& msg);
 };
 
 ImageViewerNode::ImageViewerNode(
     const std::string& in_topic,
-    bool preserve_aspect):
+    bool preserve_aspect,
+    bool async_output,
+    bool half_block,
+    bool dithering,
+    bool overlay,
+    double diagnostics_rate,
+    const std::string& trace_file,
+    bool adaptive_quality,
+    double target_fps,
+    double max_bytes_per_second,
+    roshell_graphics::ImageProtocol image_protocol,
+    int num_threads):
     in_topic_(in_topic),
-    preserve_aspect_(preserve_aspect)
+    preserve_aspect_(preserve_aspect),
+    trace_file_(trace_file),
+    half_block_(half_block),
+    image_protocol_(image_protocol)
 {
     ros::NodeHandle nh; 
     rg_ = std::make_shared<roshell_graphics::RoshellGraphics>();
+    rg_->set_async_output(async_output);
+
+    // Large terminals are encoded in bands of rows, one per thread
+    rg_->set_num_threads(num_threads);
+
+    if (half_block)
+    {
+        rg_->set_image_mode(roshell_graphics::IMAGE_MODE_HALF_BLOCK);
+    }
+
+    // Only has an effect if the terminal does not support truecolor
+    rg_->set_dithering(dithering);
+
+    // Pixels go out at the resolution of the camera if the terminal can take them
+    rg_->set_image_protocol(image_protocol_);
+
+    // Stats are only collected if something uses them
+    stats_ = rg_->get_frame_stats();
+    rg_->set_stats_overlay(overlay);
+    if (diagnostics_rate > 0.0)
+    {
+        stats_pub_ = std::make_shared<roshell_graphics::StatsPublisher>(nh, stats_, diagnostics_rate);
+    }
+    if (!trace_file_.empty())
+    {
+        stats_->set_enabled(true);
+        stats_->set_trace_capacity(65536);
+    }
+
+    // The controller is fed from the stats
+    if (adaptive_quality)
+    {
+        stats_->set_enabled(true);
+        quality_ = std::make_shared<roshell_graphics::QualityController>(target_fps, max_bytes_per_second,
+            roshell_graphics::QualityController::get_image_levels());
+        base_color_depth_ = rg_->get_color_depth();
+    }
+
     it_ = std::make_shared<image_transport::ImageTransport>(nh);
     image_sub_ = it_->subscribe(in_topic_, 1, &ImageViewerNode::image_callback, this);
 }
 
 ImageViewerNode::~ImageViewerNode()
-{}
+{
+    if (rg_->get_frames_written() > 0)
+    {
+        std::cout << "Frames written: " << rg_->get_frames_written()
+                  << ", superseded: " << rg_->get_frames_superseded() << std::endl;
+    }
+
+    if (!trace_file_.empty())
+    {
+        if (stats_->write_trace(trace_file_))
+        {
+            std::cout << "Trace written to " << trace_file_ << std::endl;
+        }
+        else
+        {
+            std::cout << "Could not write trace to " << trace_file_ << std::endl;
+        }
+    }
+}
 
 void ImageViewerNode::image_callback(const sensor_msgs::ImageConstPtr& msg)
 {
     // Convert image using cv_bridge
-    cv::Mat image = cv_bridge::toCvShare(msg, "bgr8")->image;
+    cv::Mat image;
+    {
+        roshell_graphics::StageTimer ingest(*stats_, roshell_graphics::FRAME_STAGE_INGEST);
+        image = cv_bridge::toCvShare(msg, "bgr8")->image;
+    }
 
     rg_->clear_buffer();
     rg_->add_image(image, preserve_aspect_);
     rg_->draw();
 
-    // If we want to measure time
-    // auto start = std::chrono::steady_clock::now();
-    // auto end = std::chrono::steady_clock::now();
-    // std::cout << std::endl << std::endl;
-    // std::cout <<  std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-  
+    if (quality_)
+    {
+        update_quality_();
+    }
+}
+
+/**
+ * Feeds the cost of the last frame to the quality controller and applies the
+ * level it picks to the next frames. Images are not subsampled, so their
+ * levels only give up the color depth and the half blocks, and the image
+ * protocol at low resolution, since raw pixels take more bytes than cells.
+*/
+void ImageViewerNode::update_quality_()
+{
+    uint64_t frame_ns = 0;
+    for (int stage = roshell_graphics::FRAME_STAGE_PROJECT; stage <= roshell_graphics::FRAME_STAGE_WRITE; stage++)
+    {
+        frame_ns += stats_->get_last_ns(static_cast<roshell_graphics::FrameStage>(stage));
+    }
+
+    if (!quality_->update(frame_ns, stats_->get_last_bytes()))
+    {
+        return;
+    }
+
+    const roshell_graphics::QualityLevel& quality = quality_->get_quality();
+    rg_->set_color_depth(std::max(base_color_depth_, quality.color_depth));
+    rg_->set_image_mode((half_block_ && !quality.low_resolution) ?
+        roshell_graphics::IMAGE_MODE_HALF_BLOCK : roshell_graphics::IMAGE_MODE_FULL_BLOCK);
+    rg_->set_image_protocol(quality.low_resolution ? roshell_graphics::IMAGE_PROTOCOL_CELLS : image_protocol_);
 }
 
 }   // namespace roshell_graphics 
@@ -71,6 +194,11 @@ int main(int argc, char **argv)
 
     std::string topic; // topic with image, e.g. "/wide_stereo/right/image_raw"
     bool preserve_aspect;
+    bool async_output, half_block, dithering, overlay, adaptive_quality;
+    double diagnostics_rate, target_fps, max_bytes_per_second;
+    std::string trace_file, image_protocol_name;
+    roshell_graphics::ImageProtocol image_protocol;
+    int num_threads;
     int bad_params = 0;
 
     bad_params += !pnh.getParam("in_topic", topic);
@@ -82,6 +210,33 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    roshell_graphics::ImageViewerNode ivn(topic, preserve_aspect);  
+    // Optional parameters
+    pnh.param("async_output", async_output, false);
+    pnh.param("half_block", half_block, false);
+    pnh.param("dithering", dithering, false);
+    pnh.param("overlay", overlay, false);
+    pnh.param("diagnostics_rate", diagnostics_rate, 0.0);
+    pnh.param("trace_file", trace_file, std::string(""));
+    pnh.param("adaptive_quality", adaptive_quality, false);
+    pnh.param("target_fps", target_fps, 15.0);
+    pnh.param("max_bytes_per_second", max_bytes_per_second, 0.0);
+    pnh.param("image_protocol", image_protocol_name, std::string("auto"));
+    pnh.param("num_threads", num_threads, 1);
+
+    if (adaptive_quality && target_fps <= 0.0)
+    {
+        std::cout << "target_fps must be positive with adaptive_quality! Exiting." << std::endl;
+        return 1;
+    }
+
+    if (!roshell_graphics::ImageProtocolEncoder::parse(image_protocol_name, image_protocol))
+    {
+        std::cout << "image_protocol must be one of auto, cells, kitty, kitty_png and sixel! Exiting." << std::endl;
+        return 1;
+    }
+
+    roshell_graphics::ImageViewerNode ivn(topic, preserve_aspect, async_output, half_block, dithering,
+        overlay, diagnostics_rate, trace_file, adaptive_quality, target_fps, max_bytes_per_second,
+        image_protocol, num_threads);  
     ros::spin();
 }
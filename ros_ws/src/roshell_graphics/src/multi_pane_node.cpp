@@ -0,0 +1,399 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <pcl_ros/point_cloud.h>
+#include <pcl/point_types.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <std_msgs/Float32.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <roshell_graphics/roshell_graphics.h>
+#include <roshell_graphics/perspective_projection.h>
+#include <roshell_graphics/line_plotting.h>
+#include <roshell_graphics/stats_publisher.h>
+
+namespace roshell_graphics
+{
+
+/**
+ * Draws a point cloud, a camera image and a plot of floats side by side in one
+ * terminal. Each one gets a pane of its own, and the frame is encoded and
+ * written once with all of them, at a fixed rate. Topics that are left empty
+ * get no pane.
+*/
+class MultiPaneNode
+{
+    public:
+        MultiPaneNode(
+            const std::string& cloud_topic,
+            const std::string& image_topic,
+            const std::string& float_topic,
+            const int& cam_x,
+            const int& cam_y,
+            const int& cam_z,
+            const int& cam_focal_distance,
+            const int& subsampling,
+            const bool& preserve_aspect,
+            const float& min_val,
+            const float& max_val,
+            const double& rate,
+            const bool& async_output,
+            const bool& braille,
+            const bool& half_block,
+            const int& num_threads,
+            const bool& overlay,
+            const double& diagnostics_rate,
+            const std::string& trace_file,
+            const roshell_graphics::ImageProtocol& image_protocol);
+
+        ~MultiPaneNode();
+
+        void cloud_callback(const sensor_msgs::PointCloud2::ConstPtr& msg);
+        void image_callback(const sensor_msgs::ImageConstPtr& msg);
+        void float_callback(const std_msgs::Float32::ConstPtr& msg);
+
+    private:
+        enum PaneType
+        {
+            PANE_CLOUD = 0,
+            PANE_IMAGE,
+            PANE_PLOT
+        };
+
+        struct Pane
+        {
+            PaneType type;
+            std::string title;
+        };
+
+        void render_(const ros::TimerEvent& event);
+        void draw_pane_(const Pane& pane);
+
+        // Draws everything, PlotGraph being a RoshellGraphics that can also plot
+        std::shared_ptr<roshell_graphics::PlotGraph> pg_;
+        std::shared_ptr<roshell_graphics::PerspectiveProjection> pp_;
+        std::shared_ptr<image_transport::ImageTransport> it_;
+
+        ros::Subscriber cloud_sub_;
+        image_transport::Subscriber image_sub_;
+        ros::Subscriber float_sub_;
+        ros::Timer render_timer_;
+
+        std::vector<Pane> panes_;
+
+        int subsampling_ = 1;
+        bool preserve_aspect_ = true;
+        float min_val_;
+        float max_val_;
+
+        // Newest messages, the callbacks and the timer all run on the spinner
+        // thread so no locking is needed. Clouds and images are converted as
+        // they arrive, the cloud into the same memory every time.
+        pcl::PointCloud<pcl::PointXYZ> cloud_;
+        bool has_cloud_ = false;
+        cv_bridge::CvImageConstPtr image_;
+        std::vector<float> values_;
+
+        // Stage times, published on /diagnostics and dumped to trace_file_ if
+        // they are set
+        std::shared_ptr<roshell_graphics::FrameStats> stats_;
+        std::shared_ptr<roshell_graphics::StatsPublisher> stats_pub_;
+        std::string trace_file_;
+
+        // Set when a message arrived since the last frame
+        bool dirty_ = true;
+};
+
+MultiPaneNode::MultiPaneNode(
+    const std::string& cloud_topic,
+    const std::string& image_topic,
+    const std::string& float_topic,
+    const int& cam_x,
+    const int& cam_y,
+    const int& cam_z,
+    const int& cam_focal_distance,
+    const int& subsampling,
+    const bool& preserve_aspect,
+    const float& min_val,
+    const float& max_val,
+    const double& rate,
+    const bool& async_output,
+    const bool& braille,
+    const bool& half_block,
+    const int& num_threads,
+    const bool& overlay,
+    const double& diagnostics_rate,
+    const std::string& trace_file,
+    const roshell_graphics::ImageProtocol& image_protocol):
+    subsampling_(subsampling),
+    preserve_aspect_(preserve_aspect),
+    min_val_(min_val),
+    max_val_(max_val),
+    trace_file_(trace_file)
+{
+    ros::NodeHandle nh;
+
+    pg_ = std::make_shared<roshell_graphics::PlotGraph>();
+    pg_->set_async_output(async_output);
+    pg_->set_num_threads(num_threads);
+
+    if (braille)
+    {
+        pg_->set_raster_mode(roshell_graphics::RASTER_MODE_BRAILLE);
+    }
+
+    if (half_block)
+    {
+        pg_->set_image_mode(roshell_graphics::IMAGE_MODE_HALF_BLOCK);
+    }
+    pg_->set_image_protocol(image_protocol);
+
+    // Stats are only collected if something uses them. The overlay is drawn
+    // over the titles.
+    stats_ = pg_->get_frame_stats();
+    pg_->set_stats_overlay(overlay);
+    if (diagnostics_rate > 0.0)
+    {
+        stats_pub_ = std::make_shared<roshell_graphics::StatsPublisher>(nh, stats_, diagnostics_rate);
+    }
+    if (!trace_file_.empty())
+    {
+        stats_->set_enabled(true);
+        stats_->set_trace_capacity(65536);
+    }
+
+    roshell_graphics::Camera cam;
+    cam.location = Eigen::Vector3f(cam_x, cam_y, cam_z);
+    cam.focal_distance = cam_focal_distance;
+    pp_ = std::make_shared<roshell_graphics::PerspectiveProjection>(cam);
+
+    // Panes go from left to right in this order
+    if (!cloud_topic.empty())
+    {
+        Pane pane = {PANE_CLOUD, cloud_topic};
+        panes_.push_back(pane);
+        cloud_sub_ = nh.subscribe<sensor_msgs::PointCloud2>
+            (cloud_topic, 1, &MultiPaneNode::cloud_callback, this);
+    }
+
+    if (!image_topic.empty())
+    {
+        Pane pane = {PANE_IMAGE, image_topic};
+        panes_.push_back(pane);
+        it_ = std::make_shared<image_transport::ImageTransport>(nh);
+        image_sub_ = it_->subscribe(image_topic, 1, &MultiPaneNode::image_callback, this);
+    }
+
+    if (!float_topic.empty())
+    {
+        Pane pane = {PANE_PLOT, float_topic};
+        panes_.push_back(pane);
+        float_sub_ = nh.subscribe<std_msgs::Float32>(float_topic, 10, &MultiPaneNode::float_callback, this);
+    }
+
+    render_timer_ = nh.createTimer(ros::Duration(1.0 / rate), &MultiPaneNode::render_, this);
+}
+
+MultiPaneNode::~MultiPaneNode()
+{
+    if (pg_->get_frames_written() > 0)
+    {
+        std::cout << "Frames written: " << pg_->get_frames_written()
+                  << ", superseded: " << pg_->get_frames_superseded() << std::endl;
+    }
+
+    if (!trace_file_.empty())
+    {
+        if (stats_->write_trace(trace_file_))
+        {
+            std::cout << "Trace written to " << trace_file_ << std::endl;
+        }
+        else
+        {
+            std::cout << "Could not write trace to " << trace_file_ << std::endl;
+        }
+    }
+}
+
+void MultiPaneNode::cloud_callback(const sensor_msgs::PointCloud2::ConstPtr& msg)
+{
+    roshell_graphics::StageTimer ingest(*stats_, roshell_graphics::FRAME_STAGE_INGEST);
+    pcl::fromROSMsg(*msg, cloud_);
+    has_cloud_ = true;
+    dirty_ = true;
+}
+
+void MultiPaneNode::image_callback(const sensor_msgs::ImageConstPtr& msg)
+{
+    roshell_graphics::StageTimer ingest(*stats_, roshell_graphics::FRAME_STAGE_INGEST);
+    image_ = cv_bridge::toCvShare(msg, "bgr8");
+    dirty_ = true;
+}
+
+void MultiPaneNode::float_callback(const std_msgs::Float32::ConstPtr& msg)
+{
+    values_.push_back(msg->data);
+    dirty_ = true;
+}
+
+/**
+ * Splits the terminal into one column per pane, with a separator between
+ * them and the title of each pane on its first row, and draws all of them in
+ * a single frame. Nothing is drawn if no message arrived since the last frame.
+*/
+void MultiPaneNode::render_(const ros::TimerEvent& event)
+{
+    if (!dirty_ || panes_.empty())
+    {
+        return;
+    }
+    dirty_ = false;
+
+    pg_->clear_buffer();
+
+    std::pair<int, int> term_size = pg_->get_terminal_size();
+    int num_panes = panes_.size();
+    int pane_width = (term_size.first - (num_panes - 1)) / num_panes;
+
+    for (int i = 0; i < num_panes; i++)
+    {
+        int x = i * (pane_width + 1);
+
+        // Long titles are clipped to the pane
+        roshell_graphics::Viewport title = {x, 0, pane_width, 1};
+        pg_->set_viewport(title);
+        pg_->add_text(Point(-pane_width / 2, 0), panes_[i].title);
+
+        roshell_graphics::Viewport content = {x, 1, pane_width, term_size.second - 1};
+        pg_->set_viewport(content);
+        draw_pane_(panes_[i]);
+
+        if (i + 1 < num_panes)
+        {
+            pg_->reset_viewport();
+            for (int row = 0; row < term_size.second; row++)
+            {
+                pg_->fill_buffer(Point(x + pane_width, row), "|");
+            }
+        }
+    }
+
+    pg_->reset_viewport();
+    pg_->draw();
+}
+
+/**
+ * Draws the newest message of a pane into the viewport
+*/
+void MultiPaneNode::draw_pane_(const Pane& pane)
+{
+    switch (pane.type)
+    {
+        case PANE_CLOUD:
+            if (has_cloud_)
+            {
+                // Subsampling is done by striding over the points
+                const float* points = reinterpret_cast<const float*>(cloud_.points.data());
+                size_t stride = subsampling_ * sizeof(pcl::PointXYZ) / sizeof(float);
+                pp_->add_world_points(*pg_, points, stride, cloud_.points.size() / subsampling_);
+            }
+            break;
+        case PANE_IMAGE:
+            if (image_)
+            {
+                pg_->add_image(image_->image, preserve_aspect_);
+            }
+            break;
+        case PANE_PLOT:
+            pg_->plot_points(values_, min_val_, max_val_, "Y-axis");
+            break;
+    }
+}
+
+}  // namespace roshell_graphics
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "multi_pane");
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+
+    std::string cloud_topic, image_topic, float_topic;
+    int cam_x, cam_y, cam_z, cam_focal_distance, subsampling;
+    bool preserve_aspect;
+    float min_val, max_val;
+    double rate;
+    bool async_output, braille, half_block, overlay;
+    int num_threads;
+    double diagnostics_rate;
+    std::string trace_file, image_protocol_name;
+    roshell_graphics::ImageProtocol image_protocol;
+
+    // Optional parameters, a pane is only drawn if its topic is set
+    pnh.param("cloud_topic", cloud_topic, std::string(""));
+    pnh.param("image_topic", image_topic, std::string(""));
+    pnh.param("float_topic", float_topic, std::string(""));
+    pnh.param("cam_x", cam_x, 100);
+    pnh.param("cam_y", cam_y, 100);
+    pnh.param("cam_z", cam_z, 100);
+    pnh.param("cam_focal_distance", cam_focal_distance, 1000);
+    pnh.param("subsampling", subsampling, 2);
+    pnh.param("preserve_aspect", preserve_aspect, true);
+    pnh.param("min_val", min_val, 1.0f);
+    pnh.param("max_val", max_val, 15.0f);
+    pnh.param("rate", rate, 10.0);
+    pnh.param("async_output", async_output, false);
+    pnh.param("braille", braille, false);
+    pnh.param("half_block", half_block, false);
+    pnh.param("num_threads", num_threads, 1);
+    pnh.param("overlay", overlay, false);
+    pnh.param("diagnostics_rate", diagnostics_rate, 0.0);
+    pnh.param("trace_file", trace_file, std::string(""));
+    pnh.param("image_protocol", image_protocol_name, std::string("auto"));
+
+    if (cloud_topic.empty() && image_topic.empty() && float_topic.empty())
+    {
+        std::cout << "No topic set, at least one of cloud_topic, image_topic and float_topic is needed! Exiting." << std::endl;
+        return 1;
+    }
+
+    if (rate <= 0.0 || subsampling < 1)
+    {
+        std::cout << "rate must be positive and subsampling at least 1! Exiting." << std::endl;
+        return 1;
+    }
+
+    if (!roshell_graphics::ImageProtocolEncoder::parse(image_protocol_name, image_protocol))
+    {
+        std::cout << "image_protocol must be one of auto, cells, kitty, kitty_png and sixel! Exiting." << std::endl;
+        return 1;
+    }
+
+    roshell_graphics::MultiPaneNode mpn(
+        cloud_topic,
+        image_topic,
+        float_topic,
+        cam_x,
+        cam_y,
+        cam_z,
+        cam_focal_distance,
+        subsampling,
+        preserve_aspect,
+        min_val,
+        max_val,
+        rate,
+        async_output,
+        braille,
+        half_block,
+        num_threads,
+        overlay,
+        diagnostics_rate,
+        trace_file,
+        image_protocol);
+
+    ros::spin();
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <Eigen/Dense>
 #include <pcl/io/pcd_io.h>
 #include <pcl/conversions.h>
+#include <ros/ros.h>
 
 #include <roshell_graphics/roshell_graphics.h>
 #include <roshell_graphics/perspective_projection.h>
@@ -23,25 +24,30 @@ void pcd_visualizer(
     pcl::PointCloud<pcl::PointXYZ> in_cloud;
     pcl::fromPCLPointCloud2(in_cloud_blob, in_cloud);
 
-    std::vector<pcl::PointXYZ, Eigen::aligned_allocator<pcl::PointXYZ>> points = in_cloud.points;
-
-    Eigen::Matrix3Xf points_in_world_frame(3, points.size());
-    for (int i = 0; i < points.size(); i++)
-    {
-        points_in_world_frame.col(i) << points[i].x, points[i].y, points[i].z;
-    }
-    
-    Eigen::Matrix3Xf points_in_image_plane_with_z_world = pp.project_multiple_world_points_with_z_world(points_in_world_frame);
-    rg.add_points(points_in_image_plane_with_z_world);
+    pp.add_world_points(
+        rg,
+        reinterpret_cast<const float*>(in_cloud.points.data()),
+        sizeof(pcl::PointXYZ) / sizeof(float),
+        in_cloud.points.size());
     rg.draw();
 }
 
 
 int main(int argc, char** argv)
 {   
+    ros::init(argc, argv, "pcd_visualizer");
+    ros::NodeHandle pnh("~");
+
+    // Optional parameters
+    bool depth_test;
+    pnh.param("depth_test", depth_test, true);
+
     // RoshellGraphics object
     roshell_graphics::RoshellGraphics rg;
 
+    // The nearest point colors each cell, so occluded points do not show
+    rg.set_depth_test(depth_test);
+
     // PixelProjection Object
     roshell_graphics::Camera cam;
     Eigen::Vector3f cam_loc(10, 10, 10);
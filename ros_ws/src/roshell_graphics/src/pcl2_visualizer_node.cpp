@@ -1,6 +1,9 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <pcl/io/pcd_io.h>
 #include <pcl/conversions.h>
 #include <ros/ros.h>
@@ -11,6 +14,9 @@
 
 #include <roshell_graphics/roshell_graphics.h>
 #include <roshell_graphics/perspective_projection.h>
+#include <roshell_graphics/mailbox.h>
+#include <roshell_graphics/quality_controller.h>
+#include <roshell_graphics/stats_publisher.h>
 
 namespace roshell_graphics
 {
@@ -24,21 +30,79 @@ class Pcl2VisualizerNode
             const int& cam_y,
             const int& cam_z,
             const int& cam_focal_distance,
-            const int& subsampling);
+            const int& subsampling,
+            const bool& async_output,
+            const bool& braille,
+            const int& num_threads,
+            const bool& depth_test,
+            const bool& latest_only,
+            const bool& overlay,
+            const double& diagnostics_rate,
+            const std::string& trace_file,
+            const bool& adaptive_quality,
+            const double& target_fps,
+            const double& max_bytes_per_second);
 
         ~Pcl2VisualizerNode();
 
         void pcl_visualizer_callback(
-            const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& in_cloud_msg);
-    
+            const sensor_msgs::PointCloud2::ConstPtr& in_cloud_msg);
+
+        // Stats
+        uint64_t get_frames_rendered();
+        uint64_t get_frames_dropped();
+        double get_mean_latency_ms();
+        double get_max_latency_ms();
+
     private:
+        // Cloud waiting to be drawn, with the time it arrived
+        struct PendingCloud
+        {
+            sensor_msgs::PointCloud2::ConstPtr cloud;
+            std::chrono::steady_clock::time_point received;
+        };
+
+        void render_(
+            const sensor_msgs::PointCloud2::ConstPtr& in_cloud_msg,
+            const std::chrono::steady_clock::time_point& received);
+        void render_loop_();
+        void update_quality_();
+
         std::string in_topic_;
         std::shared_ptr<roshell_graphics::RoshellGraphics> rg_;
         std::shared_ptr<roshell_graphics::PerspectiveProjection> pp_;
 
         ros::Subscriber pcl_sub_;
 
+        // Converted cloud, reused between messages. The conversion happens on
+        // the render thread, so clouds that get dropped are never converted.
+        pcl::PointCloud<pcl::PointXYZ> cloud_;
+
+        // Stage times, published on /diagnostics and dumped to trace_file_ if
+        // they are set
+        std::shared_ptr<roshell_graphics::FrameStats> stats_;
+        std::shared_ptr<roshell_graphics::StatsPublisher> stats_pub_;
+        std::string trace_file_;
+
         int subsampling_ = 1;
+
+        // Only set with adaptive quality, it scales the subsampling and caps
+        // the color depth and the Braille mode that were configured
+        std::shared_ptr<roshell_graphics::QualityController> quality_;
+        int base_subsampling_ = 1;
+        roshell_graphics::ColorDepth base_color_depth_ = roshell_graphics::COLOR_DEPTH_TRUECOLOR;
+        bool braille_ = false;
+
+        // Only used in latest only mode, the callback leaves the newest cloud
+        // in the mailbox and the render thread draws it
+        bool latest_only_ = false;
+        roshell_graphics::Mailbox<PendingCloud> mailbox_;
+        std::thread render_thread_;
+
+        // Time from the callback to the end of the draw, in microseconds
+        std::atomic<uint64_t> frames_rendered_;
+        std::atomic<uint64_t> total_latency_us_;
+        std::atomic<uint64_t> max_latency_us_;
 };
 
 Pcl2VisualizerNode::Pcl2VisualizerNode(
@@ -47,14 +111,61 @@ Pcl2VisualizerNode::Pcl2VisualizerNode(
     const int& cam_y,
     const int& cam_z,
     const int& cam_focal_distance,
-    const int& subsampling):
+    const int& subsampling,
+    const bool& async_output,
+    const bool& braille,
+    const int& num_threads,
+    const bool& depth_test,
+    const bool& latest_only,
+    const bool& overlay,
+    const double& diagnostics_rate,
+    const std::string& trace_file,
+    const bool& adaptive_quality,
+    const double& target_fps,
+    const double& max_bytes_per_second):
     in_topic_(in_topic),
-    subsampling_(subsampling)
+    trace_file_(trace_file),
+    subsampling_(subsampling),
+    base_subsampling_(subsampling),
+    braille_(braille),
+    latest_only_(latest_only),
+    frames_rendered_(0),
+    total_latency_us_(0),
+    max_latency_us_(0)
 {
     ros::NodeHandle nh;
 
     // RoshellGraphics object
     rg_ = std::make_shared<roshell_graphics::RoshellGraphics>();
+    rg_->set_async_output(async_output);
+    rg_->set_num_threads(num_threads);
+    rg_->set_depth_test(depth_test);
+
+    if (braille)
+    {
+        rg_->set_raster_mode(roshell_graphics::RASTER_MODE_BRAILLE);
+    }
+
+    // Stats are only collected if something uses them
+    stats_ = rg_->get_frame_stats();
+    rg_->set_stats_overlay(overlay);
+    if (diagnostics_rate > 0.0)
+    {
+        stats_pub_ = std::make_shared<roshell_graphics::StatsPublisher>(nh, stats_, diagnostics_rate);
+    }
+    if (!trace_file_.empty())
+    {
+        stats_->set_enabled(true);
+        stats_->set_trace_capacity(65536);
+    }
+
+    // The controller is fed from the stats
+    if (adaptive_quality)
+    {
+        stats_->set_enabled(true);
+        quality_ = std::make_shared<roshell_graphics::QualityController>(target_fps, max_bytes_per_second);
+        base_color_depth_ = rg_->get_color_depth();
+    }
 
     // PixelProjection Object
     roshell_graphics::Camera cam;
@@ -63,35 +174,172 @@ Pcl2VisualizerNode::Pcl2VisualizerNode(
     cam.focal_distance = cam_focal_distance;
     pp_ = std::make_shared<roshell_graphics::PerspectiveProjection>(cam);
 
-    pcl_sub_ = nh.subscribe<pcl::PointCloud<pcl::PointXYZ>>
-        (in_topic_, 3, &Pcl2VisualizerNode::pcl_visualizer_callback, this);
+    if (latest_only_)
+    {
+        render_thread_ = std::thread(&Pcl2VisualizerNode::render_loop_, this);
+    }
+
+    // Older clouds are worthless when only the newest one is drawn
+    pcl_sub_ = nh.subscribe<sensor_msgs::PointCloud2>
+        (in_topic_, latest_only_ ? 1 : 3, &Pcl2VisualizerNode::pcl_visualizer_callback, this);
 }
 
 Pcl2VisualizerNode::~Pcl2VisualizerNode()
 {
+    pcl_sub_.shutdown();
+    if (render_thread_.joinable())
+    {
+        mailbox_.close();
+        render_thread_.join();
+    }
+
+    if (rg_->get_frames_written() > 0)
+    {
+        std::cout << "Frames written: " << rg_->get_frames_written()
+                  << ", superseded: " << rg_->get_frames_superseded() << std::endl;
+    }
+
+    if (frames_rendered_ > 0)
+    {
+        std::cout << "Frames rendered: " << get_frames_rendered()
+                  << ", dropped: " << get_frames_dropped()
+                  << ", latency (ms) mean: " << get_mean_latency_ms()
+                  << ", max: " << get_max_latency_ms() << std::endl;
+    }
+
+    if (!trace_file_.empty())
+    {
+        if (stats_->write_trace(trace_file_))
+        {
+            std::cout << "Trace written to " << trace_file_ << std::endl;
+        }
+        else
+        {
+            std::cout << "Could not write trace to " << trace_file_ << std::endl;
+        }
+    }
 }
 
-void Pcl2VisualizerNode::pcl_visualizer_callback(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& in_cloud_msg)
+void Pcl2VisualizerNode::pcl_visualizer_callback(const sensor_msgs::PointCloud2::ConstPtr& in_cloud_msg)
 {
-    std::vector<pcl::PointXYZ, Eigen::aligned_allocator<pcl::PointXYZ>>
-        points = in_cloud_msg->points;
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
 
-    Eigen::Matrix3Xf points_in_world_frame(3, points.size() / subsampling_);
+    if (latest_only_)
+    {
+        PendingCloud pending = {in_cloud_msg, received};
+        mailbox_.put(pending);
+        return;
+    }
 
-    int idx = 0;
+    render_(in_cloud_msg, received);
+}
 
-    for (int i = 0; i < points_in_world_frame.cols(); i++)
+/**
+ * Render thread loop, always draws the newest cloud
+*/
+void Pcl2VisualizerNode::render_loop_()
+{
+    PendingCloud pending;
+    while (mailbox_.take(pending))
     {
-        points_in_world_frame.col(i) << points[idx].x, points[idx].y, points[idx].z;
-        idx += subsampling_;
+        render_(pending.cloud, pending.received);
+        pending.cloud.reset();
+    }
+}
+
+/**
+ * Converts and draws a cloud and updates the latency stats
+*/
+void Pcl2VisualizerNode::render_(
+    const sensor_msgs::PointCloud2::ConstPtr& in_cloud_msg,
+    const std::chrono::steady_clock::time_point& received)
+{
+    {
+        roshell_graphics::StageTimer ingest(*stats_, roshell_graphics::FRAME_STAGE_INGEST);
+        pcl::fromROSMsg(*in_cloud_msg, cloud_);
     }
 
-    Eigen::Matrix3Xf points_in_image_plane_with_z_world = pp_->project_multiple_world_points_with_z_world(points_in_world_frame);
+    // Subsampling is done by striding over the points
+    const float* points = reinterpret_cast<const float*>(cloud_.points.data());
+    size_t stride = subsampling_ * sizeof(pcl::PointXYZ) / sizeof(float);
 
     rg_->clear_buffer();
-    rg_->add_points(points_in_image_plane_with_z_world);
+    pp_->add_world_points(*rg_, points, stride, cloud_.points.size() / subsampling_);
 
     rg_->draw();
+
+    if (quality_)
+    {
+        update_quality_();
+    }
+
+    uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - received).count();
+    total_latency_us_ += latency_us;
+    if (latency_us > max_latency_us_)
+    {
+        max_latency_us_ = latency_us;
+    }
+    frames_rendered_++;
+}
+
+/**
+ * Feeds the cost of the last frame to the quality controller and applies the
+ * level it picks to the next frames. Ingest is left out, no level makes it
+ * cheaper.
+*/
+void Pcl2VisualizerNode::update_quality_()
+{
+    uint64_t frame_ns = 0;
+    for (int stage = roshell_graphics::FRAME_STAGE_PROJECT; stage <= roshell_graphics::FRAME_STAGE_WRITE; stage++)
+    {
+        frame_ns += stats_->get_last_ns(static_cast<roshell_graphics::FrameStage>(stage));
+    }
+
+    if (!quality_->update(frame_ns, stats_->get_last_bytes()))
+    {
+        return;
+    }
+
+    const roshell_graphics::QualityLevel& quality = quality_->get_quality();
+    subsampling_ = base_subsampling_ * quality.subsampling;
+    rg_->set_color_depth(std::max(base_color_depth_, quality.color_depth));
+    rg_->set_raster_mode((braille_ && !quality.low_resolution) ?
+        roshell_graphics::RASTER_MODE_BRAILLE : roshell_graphics::RASTER_MODE_DENSITY);
+}
+
+/**
+ * Returns the number of clouds drawn
+*/
+uint64_t Pcl2VisualizerNode::get_frames_rendered()
+{
+    return frames_rendered_;
+}
+
+/**
+ * Returns the number of clouds replaced by a newer one before being drawn,
+ * only counted in latest only mode
+*/
+uint64_t Pcl2VisualizerNode::get_frames_dropped()
+{
+    return mailbox_.get_dropped();
+}
+
+/**
+ * Returns the mean time from receiving a cloud to having drawn it
+*/
+double Pcl2VisualizerNode::get_mean_latency_ms()
+{
+    uint64_t frames = frames_rendered_;
+    return frames > 0 ? total_latency_us_ / (1000.0 * frames) : 0.0;
+}
+
+/**
+ * Returns the longest time from receiving a cloud to having drawn it
+*/
+double Pcl2VisualizerNode::get_max_latency_ms()
+{
+    return max_latency_us_ / 1000.0;
 }
 
 }  // namespace roshell_graphics
@@ -104,6 +352,10 @@ int main(int argc, char** argv)
 
     std::string in_topic = "";
     int cam_x, cam_y, cam_z, cam_focal_distance, subsampling;
+    bool async_output, braille, depth_test, latest_only, overlay, adaptive_quality;
+    int num_threads;
+    double diagnostics_rate, target_fps, max_bytes_per_second;
+    std::string trace_file;
 
     int bad_params = 0;
 
@@ -120,13 +372,43 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // Optional parameters
+    pnh.param("async_output", async_output, false);
+    pnh.param("braille", braille, false);
+    pnh.param("num_threads", num_threads, 1);
+    pnh.param("depth_test", depth_test, false);
+    pnh.param("latest_only", latest_only, false);
+    pnh.param("overlay", overlay, false);
+    pnh.param("diagnostics_rate", diagnostics_rate, 0.0);
+    pnh.param("trace_file", trace_file, std::string(""));
+    pnh.param("adaptive_quality", adaptive_quality, false);
+    pnh.param("target_fps", target_fps, 15.0);
+    pnh.param("max_bytes_per_second", max_bytes_per_second, 0.0);
+
+    if (adaptive_quality && target_fps <= 0.0)
+    {
+        std::cout << "target_fps must be positive with adaptive_quality! Exiting." << std::endl;
+        return 1;
+    }
+
     roshell_graphics::Pcl2VisualizerNode pvn(
         in_topic,
         cam_x,
         cam_y,
         cam_z,
         cam_focal_distance,
-        subsampling);
+        subsampling,
+        async_output,
+        braille,
+        num_threads,
+        depth_test,
+        latest_only,
+        overlay,
+        diagnostics_rate,
+        trace_file,
+        adaptive_quality,
+        target_fps,
+        max_bytes_per_second);
 
     ros::spin();
     return 0;
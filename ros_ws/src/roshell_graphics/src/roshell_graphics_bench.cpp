@@ -0,0 +1,393 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <Eigen/Dense>
+#include "opencv2/opencv.hpp"
+
+#include <roshell_graphics/roshell_graphics.h>
+#include <roshell_graphics/output_sink.h>
+#include <roshell_graphics/size_provider.h>
+#include <roshell_graphics/perspective_projection.h>
+
+/**
+ * Benchmark of the rendering hot paths, runs without roscore.
+ *
+ * Frames are drawn at fixed terminal sizes into a sink that only counts their
+ * bytes. The results go to stdout as JSON, progress goes to stderr:
+ *   rosrun roshell_graphics roshell_graphics_bench [--quick] [--threads N] [--simd LEVEL] > bench.json
+ *
+ * LEVEL is scalar, sse4.2 or avx2, by default the fastest the CPU supports.
+*/
+
+namespace
+{
+
+struct Timing
+{
+    double seconds;     // Per call
+    int iterations;
+};
+
+/**
+ * Calls fn until min_seconds have passed, at least 3 times, after a warm up
+*/
+Timing time_calls(const std::function<void()>& fn, double min_seconds)
+{
+    fn();
+
+    Timing t;
+    t.iterations = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < min_seconds || t.iterations < 3)
+    {
+        fn();
+        t.iterations++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    t.seconds = elapsed / t.iterations;
+    return t;
+}
+
+/**
+ * Collects the results as a JSON array of flat objects
+*/
+class Report
+{
+public:
+    void add(const std::string& name, const std::string& terminal, const std::string& input,
+        const size_t& items, const Timing& t, long bytes = -1)
+    {
+        std::ostringstream ss;
+        ss << "    {\"name\": \"" << name << "\", \"terminal\": \"" << terminal << "\""
+           << ", \"input\": \"" << input << "\", \"items\": " << items
+           << ", \"iterations\": " << t.iterations
+           << ", \"ms_per_call\": " << t.seconds * 1e3
+           << ", \"fps\": " << 1.0 / t.seconds;
+        if (items > 0)
+        {
+            ss << ", \"ns_per_item\": " << t.seconds * 1e9 / items;
+        }
+        if (bytes >= 0)
+        {
+            ss << ", \"bytes_per_frame\": " << bytes;
+        }
+        ss << "}";
+        entries_.push_back(ss.str());
+
+        std::cerr << name << " " << terminal << " " << input << ": "
+                  << t.seconds * 1e3 << " ms" << std::endl;
+    }
+
+    std::string str(const int& num_threads, const std::string& simd_level)
+    {
+        std::ostringstream ss;
+        ss << "{\n  \"num_threads\": " << num_threads << ",\n  \"simd_level\": \"" << simd_level
+           << "\",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < entries_.size(); i++)
+        {
+            ss << entries_[i] << (i + 1 < entries_.size() ? ",\n" : "\n");
+        }
+        ss << "  ]\n}\n";
+        return ss.str();
+    }
+
+private:
+    std::vector<std::string> entries_;
+};
+
+/**
+ * Points spread over a cube around the origin, seen by the default camera
+*/
+Eigen::Matrix3Xf make_cloud(const size_t& n, std::mt19937& gen)
+{
+    std::uniform_real_distribution<float> dist(-50, 50);
+    Eigen::Matrix3Xf cloud(3, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        cloud(0, i) = dist(gen);
+        cloud(1, i) = dist(gen);
+        cloud(2, i) = dist(gen);
+    }
+    return cloud;
+}
+
+/**
+ * Smooth gradients with noise, so neighbouring cells differ a little
+*/
+cv::Mat make_image(const int& width, const int& height, std::mt19937& gen)
+{
+    cv::Mat im(height, width, CV_8UC3);
+    std::uniform_int_distribution<int> noise(0, 15);
+    for (int r = 0; r < height; r++)
+    {
+        unsigned char* row = im.ptr<unsigned char>(r);
+        for (int c = 0; c < width; c++)
+        {
+            row[3 * c] = (255 * c / width + noise(gen)) & 0xff;
+            row[3 * c + 1] = (255 * r / height + noise(gen)) & 0xff;
+            row[3 * c + 2] = (255 * (c + r) / (width + height) + noise(gen)) & 0xff;
+        }
+    }
+    return im;
+}
+
+/**
+ * Endpoints anywhere on the screen and a bit outside, so clipping is exercised
+*/
+Eigen::Matrix4Xi make_lines(const int& n, const int& width, const int& height, std::mt19937& gen)
+{
+    std::uniform_int_distribution<int> dist_x(-width, width);
+    std::uniform_int_distribution<int> dist_y(-height, height);
+    Eigen::Matrix4Xi lines(4, n);
+    for (int i = 0; i < n; i++)
+    {
+        lines(0, i) = dist_x(gen);
+        lines(1, i) = dist_y(gen);
+        lines(2, i) = dist_x(gen);
+        lines(3, i) = dist_y(gen);
+    }
+    return lines;
+}
+
+std::string shape(const int& width, const int& height)
+{
+    std::ostringstream ss;
+    ss << width << "x" << height;
+    return ss.str();
+}
+
+/**
+ * Draws one frame and returns its size in bytes
+*/
+long frame_bytes(roshell_graphics::RoshellGraphics& rg, roshell_graphics::NullSink& sink, bool full)
+{
+    uint64_t before = sink.get_bytes_written();
+
+    if (full)
+    {
+        rg.force_redraw();
+    }
+    rg.draw();
+
+    return sink.get_bytes_written() - before;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    int num_threads = 1;
+    const char* simd_level = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+        {
+            simd_level = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--threads N] [--simd LEVEL]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (simd_level)
+    {
+        bool found = false;
+        for (int level = roshell_graphics::SIMD_LEVEL_SCALAR; level <= roshell_graphics::SIMD_LEVEL_AVX2; level++)
+        {
+            roshell_graphics::SimdLevel simd = static_cast<roshell_graphics::SimdLevel>(level);
+            if (strcmp(simd_level, roshell_graphics::PointBinner::get_simd_level_name(simd)) == 0)
+            {
+                found = roshell_graphics::PointBinner::set_simd_level(simd);
+            }
+        }
+        if (!found)
+        {
+            std::cerr << "Unsupported SIMD level " << simd_level << ", this CPU supports up to "
+                      << roshell_graphics::PointBinner::get_simd_level_name(
+                          roshell_graphics::PointBinner::get_max_simd_level()) << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<int, int>> terminals = {{80, 24}, {150, 40}, {400, 120}};
+    std::vector<size_t> cloud_sizes = {10000, 100000, 1000000, 2000000};
+    std::vector<std::pair<int, int>> image_sizes = {{640, 480}, {1920, 1080}, {3840, 2160}};
+    int num_lines = 1000;
+    double min_seconds = 0.2;
+    if (quick)
+    {
+        terminals = {{80, 24}, {150, 40}};
+        cloud_sizes = {10000, 100000};
+        image_sizes = {{640, 480}};
+        num_lines = 100;
+        min_seconds = 0.05;
+    }
+
+    std::mt19937 gen(42);
+    std::vector<Eigen::Matrix3Xf> clouds;
+    for (size_t i = 0; i < cloud_sizes.size(); i++)
+    {
+        clouds.push_back(make_cloud(cloud_sizes[i], gen));
+    }
+    std::vector<cv::Mat> images;
+    for (size_t i = 0; i < image_sizes.size(); i++)
+    {
+        images.push_back(make_image(image_sizes[i].first, image_sizes[i].second, gen));
+    }
+
+    std::shared_ptr<roshell_graphics::NullSink> sink = std::make_shared<roshell_graphics::NullSink>();
+    std::shared_ptr<roshell_graphics::FixedSizeProvider> size =
+        std::make_shared<roshell_graphics::FixedSizeProvider>(terminals[0].first, terminals[0].second);
+    roshell_graphics::RoshellGraphics rg(sink, size);
+    rg.set_num_threads(num_threads);
+    rg.set_color_depth(roshell_graphics::COLOR_DEPTH_TRUECOLOR);
+
+    roshell_graphics::Camera cam;
+    cam.location << 100, 100, 100;
+    cam.focal_distance = 1000;
+    roshell_graphics::PerspectiveProjection pp(cam);
+
+    Report report;
+    for (size_t t = 0; t < terminals.size(); t++)
+    {
+        int width = terminals[t].first;
+        int height = terminals[t].second;
+        std::string term = shape(width, height);
+        size->set_size(width, height);
+        rg.update_buffer();
+        rg.set_raster_mode(roshell_graphics::RASTER_MODE_DENSITY);
+
+        report.add("clear_buffer", term, "", 0, time_calls([&]() { rg.clear_buffer(); }, min_seconds));
+
+        // Lines, one at a time and batched
+        Eigen::Matrix4Xi lines = make_lines(num_lines, width, height, gen);
+        std::string lines_input = std::to_string(num_lines) + " lines";
+        report.add("add_line", term, lines_input, num_lines, time_calls([&]()
+        {
+            rg.clear_buffer();
+            for (int i = 0; i < num_lines; i++)
+            {
+                rg.add_line(roshell_graphics::Point(lines(0, i), lines(1, i)),
+                            roshell_graphics::Point(lines(2, i), lines(3, i)), "*");
+            }
+        }, min_seconds));
+        report.add("add_lines", term, lines_input, num_lines, time_calls([&]()
+        {
+            rg.clear_buffer();
+            rg.add_lines(lines, "*");
+        }, min_seconds));
+
+        // Points, already projected and projected on the way in
+        for (size_t i = 0; i < clouds.size(); i++)
+        {
+            const Eigen::Matrix3Xf& cloud = clouds[i];
+            std::string input = std::to_string(cloud.cols()) + " points";
+            Eigen::Matrix3Xf projected = pp.project_multiple_world_points_with_z_world(cloud);
+
+            report.add("project_multiple_world_points_with_z_world", term, input, cloud.cols(),
+                time_calls([&]() { projected = pp.project_multiple_world_points_with_z_world(cloud); }, min_seconds));
+
+            for (int braille = 0; braille < 2; braille++)
+            {
+                rg.set_raster_mode(braille ? roshell_graphics::RASTER_MODE_BRAILLE
+                                           : roshell_graphics::RASTER_MODE_DENSITY);
+                std::string suffix = braille ? "_braille" : "";
+
+                report.add("add_points" + suffix, term, input, cloud.cols(), time_calls([&]()
+                {
+                    rg.clear_buffer();
+                    rg.add_points(projected);
+                }, min_seconds));
+
+                report.add("add_world_points" + suffix, term, input, cloud.cols(), time_calls([&]()
+                {
+                    rg.clear_buffer();
+                    pp.add_world_points(rg, cloud.data(), 3, cloud.cols());
+                }, min_seconds));
+            }
+            rg.set_raster_mode(roshell_graphics::RASTER_MODE_DENSITY);
+        }
+
+        // Images, in both modes
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            std::string input = shape(images[i].cols, images[i].rows) + " image";
+            for (int half = 0; half < 2; half++)
+            {
+                rg.set_image_mode(half ? roshell_graphics::IMAGE_MODE_HALF_BLOCK
+                                       : roshell_graphics::IMAGE_MODE_FULL_BLOCK);
+                report.add(half ? "add_image_half_block" : "add_image", term, input,
+                    (size_t)images[i].rows * images[i].cols, time_calls([&]()
+                {
+                    rg.clear_buffer();
+                    rg.add_image(images[i]);
+                }, min_seconds));
+            }
+        }
+
+        // Whole frames of a sparse plot, where few cells are set or change
+        Eigen::Matrix4Xi plot = make_lines(20, width / 2, height / 2, gen);
+        report.add("sparse_frame", term, "20 lines", 0, time_calls([&]()
+        {
+            rg.clear_buffer();
+            rg.add_lines(plot, "*");
+            rg.draw();
+        }, min_seconds));
+
+        // Frames, redrawn from scratch and redrawn unchanged
+        struct Scene
+        {
+            std::string input;
+            std::function<void()> fill;
+        };
+        std::vector<Scene> scenes = {
+            {"points", [&]() { rg.add_points(pp.project_multiple_world_points_with_z_world(clouds[0])); }},
+            {"image", [&]() { rg.add_image(images[0]); }}};
+
+        for (size_t i = 0; i < scenes.size(); i++)
+        {
+            rg.set_image_mode(roshell_graphics::IMAGE_MODE_FULL_BLOCK);
+            rg.clear_buffer();
+            scenes[i].fill();
+
+            long full_bytes = frame_bytes(rg, *sink, true);
+            report.add("draw_full", term, scenes[i].input, 0, time_calls([&]()
+            {
+                rg.force_redraw();
+                rg.draw();
+            }, min_seconds), full_bytes);
+
+            long same_bytes = frame_bytes(rg, *sink, false);
+            report.add("draw_unchanged", term, scenes[i].input, 0, time_calls([&]()
+            {
+                rg.draw();
+            }, min_seconds), same_bytes);
+        }
+    }
+
+    std::cout << report.str(rg.get_num_threads(),
+        roshell_graphics::PointBinner::get_simd_level_name(roshell_graphics::PointBinner::get_simd_level()));
+
+    return 0;
+}
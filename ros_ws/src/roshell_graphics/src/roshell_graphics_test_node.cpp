@@ -99,6 +99,16 @@ void draw_rotating_cube(
     
     Eigen::Matrix2Xf points_in_image_frame(2, 8);
 
+    // Edges of the bottom face, the top face and the sides, the first of
+    // each marked
+    const int edge_start[12] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3};
+    const int edge_end[12] = {1, 2, 3, 0, 5, 6, 7, 4, 4, 5, 6, 7};
+    std::vector<std::string> edge_chars(12, c);
+    edge_chars[0] = "&"; // example
+    edge_chars[4] = "G";
+    edge_chars[8] = "M";
+    Eigen::Matrix4Xi edges(4, 12);
+
     roshell_graphics::Camera cam;
     Eigen::Vector3f cam_loc(40000, 50000, 25000);
     cam.location = cam_loc;
@@ -123,45 +133,15 @@ void draw_rotating_cube(
                 pp.project_world_point(points_in_world_frame.col(i));
         }
 
-        roshell_graphics::Point p1, p2, p3, p4, p5, p6, p7, p8;
-        p1(0) = points_in_image_frame(0, 0);
-        p1(1) = points_in_image_frame(1, 0);
-
-        p2(0) = points_in_image_frame(0, 1);
-        p2(1) = points_in_image_frame(1, 1);
-
-        p3(0) = points_in_image_frame(0, 2);
-        p3(1) = points_in_image_frame(1, 2);
-
-        p4(0) = points_in_image_frame(0, 3);
-        p4(1) = points_in_image_frame(1, 3);
-
-        p5(0) = points_in_image_frame(0, 4);
-        p5(1) = points_in_image_frame(1, 4);
-
-        p6(0) = points_in_image_frame(0, 5);
-        p6(1) = points_in_image_frame(1, 5);
-
-        p7(0) = points_in_image_frame(0, 6);
-        p7(1) = points_in_image_frame(1, 6);
-
-        p8(0) = points_in_image_frame(0, 7);
-        p8(1) = points_in_image_frame(1, 7);
-
-        rg.add_line(p1, p2, "&"); // example
-        rg.add_line(p2, p3, c);
-        rg.add_line(p3, p4, c);
-        rg.add_line(p4, p1, c);
-
-        rg.add_line(p5, p6, "G");
-        rg.add_line(p6, p7, c);
-        rg.add_line(p7, p8, c);
-        rg.add_line(p8, p5, c);
-
-        rg.add_line(p1, p5, "M");
-        rg.add_line(p2, p6, c);
-        rg.add_line(p3, p7, c);
-        rg.add_line(p4, p8, c);
+        // Both ends of every edge, drawn in one batch
+        for (int i = 0; i < 12; i++)
+        {
+            edges(0, i) = points_in_image_frame(0, edge_start[i]);
+            edges(1, i) = points_in_image_frame(1, edge_start[i]);
+            edges(2, i) = points_in_image_frame(0, edge_end[i]);
+            edges(3, i) = points_in_image_frame(1, edge_end[i]);
+        }
+        rg.add_lines(edges, edge_chars);
 
         rg.draw_and_clear(10e4);
     }
@@ -192,6 +172,7 @@ int main(int argc, char** argv)
     /**
      * Uncomment following lines to try these functions
     */
+    // rg.set_raster_mode(roshell_graphics::RASTER_MODE_BRAILLE);
     // std::pair<int, int> term_size = rg.get_terminal_size();
     // draw_random_lines(rg, 10, term_size.first, term_size.second, 5e5);
     // draw_lines(rg);
@@ -0,0 +1,179 @@
+#include <roshell_graphics/perspective_projection.h>
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace roshell_graphics;
+
+/**
+ * Checks that with the depth test on the nearest point colors a cell, in
+ * whatever order the points come and on however many threads they are binned
+*/
+
+namespace
+{
+
+// x, y, z, depth quadruplets
+typedef std::vector<float> Points;
+
+// Point source over the quadruplets
+RoshellGraphics::PointSource source_of(const Points& points)
+{
+    return [&points](const size_t& start, const size_t& len, float* xyzd)
+    {
+        std::copy(points.begin() + 4 * start, points.begin() + 4 * (start + len), xyzd);
+    };
+}
+
+// Draws every group of points with its own add_points() call and returns the
+// frame
+std::string draw_frame(const RasterMode& raster_mode, const bool& depth_test, const int& num_threads,
+    const std::vector<Points>& groups)
+{
+    auto sink = std::make_shared<MemorySink>();
+    RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(80, 24));
+    rg.set_color_depth(COLOR_DEPTH_TRUECOLOR);
+    rg.set_raster_mode(raster_mode);
+    rg.set_depth_test(depth_test);
+    rg.set_num_threads(num_threads);
+    rg.clear_buffer();
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        rg.add_points(source_of(groups[i]), groups[i].size() / 4, true, -10.0f, 10.0f);
+    }
+    rg.draw();
+    return sink->get_frame(0);
+}
+
+Points concat(const Points& a, const Points& b)
+{
+    Points points = a;
+    points.insert(points.end(), b.begin(), b.end());
+    return points;
+}
+
+// Same dot, low and close, or high and far
+const Points near_point = {3.2f, 1.3f, -9.0f, 2.0f};
+const Points far_point = {3.2f, 1.3f, 9.0f, 20.0f};
+
+}  // namespace
+
+TEST(DepthTest, NearestPointWins)
+{
+    RasterMode modes[2] = {RASTER_MODE_DENSITY, RASTER_MODE_BRAILLE};
+    for (int m = 0; m < 2; m++)
+    {
+        // Two points on the same dot, so only the color can differ
+        std::string expected = draw_frame(modes[m], true, 1, {concat(near_point, near_point)});
+        ASSERT_FALSE(expected == draw_frame(modes[m], true, 1, {concat(far_point, far_point)}));
+
+        // In one call, in both orders
+        EXPECT_TRUE(draw_frame(modes[m], true, 1, {concat(near_point, far_point)}) == expected) << "mode " << m;
+        EXPECT_TRUE(draw_frame(modes[m], true, 1, {concat(far_point, near_point)}) == expected) << "mode " << m;
+
+        // In separate calls, in both orders
+        EXPECT_TRUE(draw_frame(modes[m], true, 1, {near_point, far_point}) == expected) << "mode " << m;
+        EXPECT_TRUE(draw_frame(modes[m], true, 1, {far_point, near_point}) == expected) << "mode " << m;
+
+        // Without the depth test the last point wins
+        EXPECT_FALSE(draw_frame(modes[m], false, 1, {concat(near_point, far_point)}) == expected) << "mode " << m;
+        EXPECT_TRUE(draw_frame(modes[m], false, 1, {concat(far_point, near_point)}) == expected) << "mode " << m;
+    }
+}
+
+// The nearest point wins even when the two land on different threads
+TEST(DepthTest, NearestPointWinsAcrossThreads)
+{
+    // Enough points to be split between threads, with the two points of
+    // the same dot at either end of the cloud
+    Points filler;
+    for (int i = 0; i < 70000; i++)
+    {
+        const float point[4] = {-30.0f + (i % 60), -8.0f, 0.0f, 5.0f};
+        filler.insert(filler.end(), point, point + 4);
+    }
+
+    RasterMode modes[2] = {RASTER_MODE_DENSITY, RASTER_MODE_BRAILLE};
+    for (int m = 0; m < 2; m++)
+    {
+        std::string near_first = draw_frame(modes[m], true, 8, {concat(concat(near_point, filler), far_point)});
+        std::string far_first = draw_frame(modes[m], true, 8, {concat(concat(far_point, filler), near_point)});
+        std::string expected = draw_frame(modes[m], true, 1, {concat(concat(near_point, filler), near_point)});
+        EXPECT_TRUE(near_first == expected) << "mode " << m;
+        EXPECT_TRUE(far_first == expected) << "mode " << m;
+    }
+}
+
+TEST(DepthTest, SameFrameOnEveryThreadCount)
+{
+    // A dense cloud, with whole depths so that some points tie
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> x(-40.0f, 39.9f);
+    std::uniform_real_distribution<float> y(-11.9f, 12.0f);
+    std::uniform_real_distribution<float> z(-10.0f, 10.0f);
+    std::uniform_int_distribution<int> depth(1, 50);
+    Points cloud;
+    for (int i = 0; i < 70001; i++)
+    {
+        const float point[4] = {x(rng), y(rng), z(rng), static_cast<float>(depth(rng))};
+        cloud.insert(cloud.end(), point, point + 4);
+    }
+
+    RasterMode modes[2] = {RASTER_MODE_DENSITY, RASTER_MODE_BRAILLE};
+    int thread_counts[2] = {2, 8};
+    for (int m = 0; m < 2; m++)
+    {
+        std::string expected = draw_frame(modes[m], true, 1, {cloud});
+        for (int t = 0; t < 2; t++)
+        {
+            EXPECT_TRUE(draw_frame(modes[m], true, thread_counts[t], {cloud}) == expected)
+                << "mode " << m << ", " << thread_counts[t] << " threads";
+        }
+    }
+}
+
+// Projected clouds, whose depth is the distance to the camera
+TEST(DepthTest, ProjectedCloudOnEveryThreadCount)
+{
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+    Eigen::Matrix3Xf cloud(3, 70001);
+    for (int i = 0; i < cloud.cols(); i++)
+    {
+        cloud(0, i) = coordinate(rng);
+        cloud(1, i) = coordinate(rng);
+        cloud(2, i) = coordinate(rng);
+    }
+
+    Camera camera;
+    camera.location << 100, 100, 100;
+    camera.focal_distance = 300;
+    PerspectiveProjection projection(camera);
+
+    std::string expected;
+    int thread_counts[3] = {1, 2, 8};
+    for (int t = 0; t < 3; t++)
+    {
+        auto sink = std::make_shared<MemorySink>();
+        RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(80, 24));
+        rg.set_color_depth(COLOR_DEPTH_TRUECOLOR);
+        rg.set_depth_test(true);
+        rg.set_num_threads(thread_counts[t]);
+        rg.clear_buffer();
+        projection.add_world_points(rg, cloud.data(), 3, cloud.cols());
+        rg.draw();
+
+        if (t == 0)
+        {
+            expected = sink->get_frame(0);
+        }
+        else
+        {
+            EXPECT_TRUE(sink->get_frame(0) == expected) << thread_counts[t] << " threads";
+        }
+    }
+}
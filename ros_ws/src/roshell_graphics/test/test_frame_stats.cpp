@@ -0,0 +1,381 @@
+#include <roshell_graphics/frame_stats.h>
+
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace roshell_graphics;
+
+/**
+ * Checks the histogram buckets and percentiles, the Chrome trace and that
+ * nothing is timed while the stats are disabled
+*/
+
+namespace
+{
+
+// Minimal JSON parser, only checks that the text is valid
+class JsonChecker
+{
+public:
+    explicit JsonChecker(const std::string& text):
+        text_(text),
+        pos_(0)
+    {
+    }
+
+    bool is_valid()
+    {
+        pos_ = 0;
+        if (!value_())
+        {
+            return false;
+        }
+        skip_spaces_();
+        return pos_ == text_.size();
+    }
+
+private:
+    void skip_spaces_()
+    {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_])))
+        {
+            pos_++;
+        }
+    }
+
+    bool literal_(const char* word)
+    {
+        size_t len = std::strlen(word);
+        if (text_.compare(pos_, len, word) != 0)
+        {
+            return false;
+        }
+        pos_ += len;
+        return true;
+    }
+
+    bool string_()
+    {
+        if (text_[pos_] != '"')
+        {
+            return false;
+        }
+        for (pos_++; pos_ < text_.size(); pos_++)
+        {
+            char c = text_[pos_];
+            if (c == '"')
+            {
+                pos_++;
+                return true;
+            }
+            if (c == '\\')
+            {
+                pos_++;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool number_()
+    {
+        size_t start = pos_;
+        if (text_[pos_] == '-')
+        {
+            pos_++;
+        }
+        size_t digits = pos_;
+        while (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_])))
+        {
+            pos_++;
+        }
+        if (pos_ == digits)
+        {
+            return false;
+        }
+        if (pos_ < text_.size() && text_[pos_] == '.')
+        {
+            size_t fraction = ++pos_;
+            while (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_])))
+            {
+                pos_++;
+            }
+            if (pos_ == fraction)
+            {
+                return false;
+            }
+        }
+        return pos_ > start;
+    }
+
+    // Object or array, whose items are parsed by item
+    template <typename Item>
+    bool container_(const char& open, const char& close, const Item& item)
+    {
+        if (text_[pos_] != open)
+        {
+            return false;
+        }
+        pos_++;
+        skip_spaces_();
+        if (pos_ < text_.size() && text_[pos_] == close)
+        {
+            pos_++;
+            return true;
+        }
+        while (true)
+        {
+            if (!item())
+            {
+                return false;
+            }
+            skip_spaces_();
+            if (pos_ >= text_.size())
+            {
+                return false;
+            }
+            if (text_[pos_] == close)
+            {
+                pos_++;
+                return true;
+            }
+            if (text_[pos_] != ',')
+            {
+                return false;
+            }
+            pos_++;
+        }
+    }
+
+    bool value_()
+    {
+        skip_spaces_();
+        if (pos_ >= text_.size())
+        {
+            return false;
+        }
+        switch (text_[pos_])
+        {
+            case '{':
+                return container_('{', '}', [this]()
+                {
+                    skip_spaces_();
+                    if (pos_ >= text_.size() || !string_())
+                    {
+                        return false;
+                    }
+                    skip_spaces_();
+                    if (pos_ >= text_.size() || text_[pos_] != ':')
+                    {
+                        return false;
+                    }
+                    pos_++;
+                    return value_();
+                });
+            case '[':
+                return container_('[', ']', [this]() { return value_(); });
+            case '"':
+                return string_();
+            case 't':
+                return literal_("true");
+            case 'f':
+                return literal_("false");
+            case 'n':
+                return literal_("null");
+            default:
+                return number_();
+        }
+    }
+
+    const std::string& text_;
+    size_t pos_;
+};
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// Number of times pattern appears in text
+size_t count(const std::string& text, const std::string& pattern)
+{
+    size_t n = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+    {
+        n++;
+    }
+    return n;
+}
+
+}  // namespace
+
+TEST(Histogram, BucketsRoundTrip)
+{
+    // One bucket per value below 16, then 8 per power of two
+    for (uint64_t value = 0; value < 16; value++)
+    {
+        EXPECT_EQ(static_cast<int>(value), Histogram::get_bucket(value));
+        EXPECT_EQ(value, Histogram::get_bucket_upper_bound(value));
+    }
+    EXPECT_EQ(16, Histogram::get_bucket(16));
+    EXPECT_EQ(16, Histogram::get_bucket(17));
+    EXPECT_EQ(17, Histogram::get_bucket(18));
+    EXPECT_EQ(17u, Histogram::get_bucket_upper_bound(16));
+
+    // Powers of two start a bucket, the value before them ends one
+    for (int exponent = 4; exponent < 64; exponent++)
+    {
+        uint64_t power = static_cast<uint64_t>(1) << exponent;
+        int bucket = 16 + (exponent - 4) * 8;
+        EXPECT_EQ(bucket, Histogram::get_bucket(power)) << "2^" << exponent;
+        EXPECT_EQ(bucket - 1, Histogram::get_bucket(power - 1)) << "2^" << exponent;
+        EXPECT_EQ(power - 1, Histogram::get_bucket_upper_bound(bucket - 1)) << "2^" << exponent;
+    }
+
+    // Every upper bound is in its bucket and the next value in the next one
+    const int num_buckets = Histogram::NUM_BUCKETS;
+    for (int bucket = 0; bucket < num_buckets; bucket++)
+    {
+        uint64_t upper = Histogram::get_bucket_upper_bound(bucket);
+        EXPECT_EQ(bucket, Histogram::get_bucket(upper)) << "bucket " << bucket;
+        if (bucket + 1 < num_buckets)
+        {
+            EXPECT_EQ(bucket + 1, Histogram::get_bucket(upper + 1)) << "bucket " << bucket;
+        }
+    }
+    EXPECT_EQ(UINT64_MAX, Histogram::get_bucket_upper_bound(num_buckets - 1));
+}
+
+TEST(Histogram, PercentilesWithinTheBucketWidth)
+{
+    // 1 to 10000, whose p-th percentile is 1 + p% of 9999
+    Histogram histogram;
+    for (uint64_t value = 10000; value >= 1; value--)
+    {
+        histogram.record(value);
+    }
+    EXPECT_EQ(10000u, histogram.get_count());
+    EXPECT_EQ(10000u, histogram.get_max());
+    EXPECT_DOUBLE_EQ(5000.5, histogram.get_mean());
+
+    double percentiles[] = {0, 50, 99, 100};
+    uint64_t exact[] = {1, 5000, 9900, 10000};
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t value = histogram.get_percentile(percentiles[i]);
+        EXPECT_GE(value, exact[i]) << "p" << percentiles[i];
+        EXPECT_LE(value, exact[i] * 1.125) << "p" << percentiles[i];
+    }
+
+    // The largest value is never overshot
+    EXPECT_EQ(10000u, histogram.get_percentile(100));
+
+    // A few slow frames only show in the tail
+    Histogram skewed;
+    for (int i = 0; i < 990; i++)
+    {
+        skewed.record(1000000);
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        skewed.record(50000000);
+    }
+    EXPECT_GE(skewed.get_percentile(50), 1000000u);
+    EXPECT_LE(skewed.get_percentile(50), 1125000u);
+    EXPECT_LE(skewed.get_percentile(99), 1125000u);
+    EXPECT_GE(skewed.get_percentile(99.5), 50000000u);
+    EXPECT_EQ(50000000u, skewed.get_percentile(100));
+
+    Histogram empty;
+    EXPECT_EQ(0u, empty.get_percentile(50));
+}
+
+TEST(FrameStats, TraceIsValidJsonAfterWrapping)
+{
+    FrameStats stats;
+    stats.set_trace_capacity(8);
+
+    // 21 spans, the i-th lasting i microseconds, so only 14 to 21 are kept
+    StatsClock::time_point start = StatsClock::now();
+    for (int i = 1; i <= 21; i++)
+    {
+        StatsClock::time_point span_start = start + std::chrono::milliseconds(i);
+        stats.trace(static_cast<FrameStage>(i % FRAME_STAGE_COUNT), span_start,
+            span_start + std::chrono::microseconds(i), (i % 2) ? 0 : 100 * i);
+    }
+
+    std::string path = ::testing::TempDir() + "roshell_graphics_trace.json";
+    ASSERT_TRUE(stats.write_trace(path));
+    std::string trace = read_file(path);
+    std::remove(path.c_str());
+
+    EXPECT_TRUE(JsonChecker(trace).is_valid()) << trace;
+    EXPECT_EQ(8u, count(trace, "\"ph\": \"X\""));
+    for (int i = 1; i <= 21; i++)
+    {
+        std::string duration = "\"dur\": " + std::to_string(i) + ".000";
+        EXPECT_EQ(i > 13 ? 1u : 0u, count(trace, duration)) << "span " << i;
+    }
+
+    // Times are relative to the oldest span kept
+    EXPECT_EQ(1u, count(trace, "\"ts\": 0.000,"));
+    EXPECT_EQ(1u, count(trace, "\"args\": {\"bytes\": 2000}"));
+
+    // An empty trace is valid too
+    stats.set_trace_capacity(4);
+    ASSERT_TRUE(stats.write_trace(path));
+    trace = read_file(path);
+    std::remove(path.c_str());
+    EXPECT_TRUE(JsonChecker(trace).is_valid()) << trace;
+    EXPECT_EQ(0u, count(trace, "\"ph\""));
+}
+
+TEST(FrameStats, StageTimerOnlyTimesWhileEnabled)
+{
+    FrameStats stats;
+    stats.set_trace_capacity(4);
+
+    {
+        StageTimer timer(stats, FRAME_STAGE_INGEST);
+    }
+    EXPECT_EQ(0u, stats.get_histogram(FRAME_STAGE_INGEST).get_count());
+    EXPECT_EQ(0u, stats.get_last_ns(FRAME_STAGE_INGEST));
+
+    // Enabled or disabled halfway through
+    {
+        StageTimer timer(stats, FRAME_STAGE_INGEST);
+        stats.set_enabled(true);
+    }
+    EXPECT_EQ(0u, stats.get_histogram(FRAME_STAGE_INGEST).get_count());
+    {
+        StageTimer timer(stats, FRAME_STAGE_INGEST);
+        stats.set_enabled(false);
+    }
+    EXPECT_EQ(0u, stats.get_histogram(FRAME_STAGE_INGEST).get_count());
+
+    std::string path = ::testing::TempDir() + "roshell_graphics_trace.json";
+    ASSERT_TRUE(stats.write_trace(path));
+    EXPECT_EQ(0u, count(read_file(path), "\"ph\""));
+
+    // And once enabled
+    stats.set_enabled(true);
+    {
+        StageTimer timer(stats, FRAME_STAGE_INGEST);
+    }
+    EXPECT_EQ(1u, stats.get_histogram(FRAME_STAGE_INGEST).get_count());
+    ASSERT_TRUE(stats.write_trace(path));
+    EXPECT_EQ(1u, count(read_file(path), "\"ph\""));
+    std::remove(path.c_str());
+}
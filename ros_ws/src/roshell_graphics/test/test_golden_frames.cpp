@@ -0,0 +1,196 @@
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace roshell_graphics;
+
+/**
+ * Draws scenes without a terminal and compares the bytes sent to the sink
+ * against the frames in test/golden. Running the test with
+ * ROSHELL_GRAPHICS_UPDATE_GOLDEN set rewrites the golden frames instead.
+*/
+
+namespace
+{
+
+const int width = 40;
+const int height = 12;
+
+class GoldenFrames : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        sink_ = std::make_shared<MemorySink>();
+        rg_ = std::make_shared<RoshellGraphics>(sink_, std::make_shared<FixedSizeProvider>(width, height));
+        rg_->set_color_depth(COLOR_DEPTH_TRUECOLOR);
+        rg_->clear_buffer();
+    }
+
+    // Compares the last frame against the golden frame called name
+    void expect_golden(const std::string& name)
+    {
+        ASSERT_GT(sink_->get_num_frames(), 0u);
+        std::string frame = sink_->get_frame(sink_->get_num_frames() - 1);
+        std::string path = std::string(GOLDEN_DIR) + "/" + name + ".frame";
+
+        if (std::getenv("ROSHELL_GRAPHICS_UPDATE_GOLDEN"))
+        {
+            std::ofstream file(path.c_str(), std::ios::binary);
+            file << frame;
+            return;
+        }
+
+        std::ifstream file(path.c_str(), std::ios::binary);
+        ASSERT_TRUE(file.good()) << "missing golden frame " << path;
+        std::stringstream golden;
+        golden << file.rdbuf();
+
+        EXPECT_EQ(golden.str().size(), frame.size()) << "frame differs from " << path;
+        EXPECT_TRUE(golden.str() == frame) << "frame differs from " << path;
+    }
+
+    // cols x rows pixels with a different color in each
+    cv::Mat gradient_(const int& cols, const int& rows)
+    {
+        cv::Mat im(rows, cols, CV_8UC3);
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < cols; x++)
+            {
+                cv::Vec3b& pixel = im.at<cv::Vec3b>(y, x);
+                pixel[0] = static_cast<unsigned char>(x * 255 / (cols - 1));
+                pixel[1] = static_cast<unsigned char>(y * 255 / (rows - 1));
+                pixel[2] = static_cast<unsigned char>((x + y) * 4);
+            }
+        }
+        return im;
+    }
+
+    std::shared_ptr<MemorySink> sink_;
+    std::shared_ptr<RoshellGraphics> rg_;
+};
+
+// Points in natural frame, stacked up to show every density
+Eigen::Matrix2Xf density_points()
+{
+    Eigen::Matrix2Xf points(2, 28);
+    int k = 0;
+    for (int count = 1; count <= 7; count++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            points(0, k) = -15.0f + 5.0f * count;
+            points(1, k) = count % 3 - 1.0f;
+            k++;
+        }
+    }
+    return points;
+}
+
+}  // namespace
+
+TEST_F(GoldenFrames, Points)
+{
+    Eigen::Matrix2Xf points(2, 5);
+    points << -20, -5, 0, 7, 19,
+              5, -3, 0, 2, -6;
+    rg_->add_points(points);
+    rg_->draw();
+    expect_golden("points");
+}
+
+TEST_F(GoldenFrames, Lines)
+{
+    rg_->add_natural_frame();
+    rg_->add_line(Point(-18, -5), Point(18, 5), "*");
+    rg_->add_line(Point(-30, 4), Point(30, -4), "+");
+    rg_->draw();
+    expect_golden("lines");
+}
+
+TEST_F(GoldenFrames, Density)
+{
+    rg_->add_points(density_points());
+    rg_->draw();
+    expect_golden("density");
+}
+
+TEST_F(GoldenFrames, Braille)
+{
+    rg_->set_raster_mode(RASTER_MODE_BRAILLE);
+    rg_->clear_buffer();
+
+    // Dots are half a cell wide and a quarter of a cell high
+    Eigen::Matrix2Xf points(2, 64);
+    for (int i = 0; i < 64; i++)
+    {
+        points(0, i) = -16.0f + i * 0.5f;
+        points(1, i) = (i % 16) * 0.25f - 2.0f;
+    }
+    rg_->add_points(points);
+    rg_->draw();
+    expect_golden("braille");
+}
+
+TEST_F(GoldenFrames, ImageTruecolor)
+{
+    rg_->add_image(gradient_(width, height), false);
+    rg_->draw();
+    expect_golden("image_truecolor");
+}
+
+TEST_F(GoldenFrames, Image256)
+{
+    rg_->set_color_depth(COLOR_DEPTH_256);
+    rg_->add_image(gradient_(width, height), false);
+    rg_->draw();
+    expect_golden("image_256");
+}
+
+TEST_F(GoldenFrames, Image16)
+{
+    rg_->set_color_depth(COLOR_DEPTH_16);
+    rg_->add_image(gradient_(width, height), false);
+    rg_->draw();
+    expect_golden("image_16");
+}
+
+TEST_F(GoldenFrames, HalfBlockImage)
+{
+    rg_->set_image_mode(IMAGE_MODE_HALF_BLOCK);
+    rg_->add_image(gradient_(width, 2 * height), false);
+    rg_->draw();
+    expect_golden("image_half_block");
+}
+
+// The second frame only writes the cells that changed
+TEST_F(GoldenFrames, Incremental)
+{
+    rg_->add_natural_frame();
+    rg_->add_points(density_points());
+    rg_->draw();
+    expect_golden("incremental_first");
+    size_t first_len = sink_->get_frame(0).size();
+
+    rg_->clear_buffer();
+    rg_->add_natural_frame();
+    Eigen::Matrix2Xf points = density_points();
+    points.row(1).array() += 3.0f;
+    rg_->add_points(points);
+    rg_->draw();
+    expect_golden("incremental_second");
+    EXPECT_LT(sink_->get_frame(1).size(), first_len);
+
+    // Nothing changed, so nothing is written
+    rg_->clear_buffer();
+    rg_->add_natural_frame();
+    rg_->add_points(points);
+    rg_->draw();
+    ASSERT_EQ(3u, sink_->get_num_frames());
+    EXPECT_TRUE(sink_->get_frame(2).empty());
+}
@@ -0,0 +1,552 @@
+#include <roshell_graphics/image_protocol.h>
+#include <roshell_graphics/palette.h>
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace roshell_graphics;
+
+/**
+ * Checks the escape sequences of the image protocols by decoding them back
+ * into pixels, as a terminal would
+*/
+
+namespace
+{
+
+// Kitty graphics command, split into its control data and payload
+struct KittyChunk
+{
+    std::string control;
+    std::string payload;
+};
+
+// Splits every Kitty graphics command out of data, false if one is not
+// terminated
+bool parse_kitty(const std::string& data, std::vector<KittyChunk>& chunks)
+{
+    size_t pos = 0;
+    while ((pos = data.find("\033_G", pos)) != std::string::npos)
+    {
+        size_t end = data.find("\033\\", pos);
+        if (end == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string command = data.substr(pos + 3, end - pos - 3);
+        size_t separator = command.find(';');
+        KittyChunk chunk;
+        chunk.control = command.substr(0, separator);
+        chunk.payload = (separator == std::string::npos) ? "" : command.substr(separator + 1);
+        chunks.push_back(chunk);
+        pos = end + 2;
+    }
+    return true;
+}
+
+// Value of key in the control data of a chunk, empty if it is not there
+std::string control_value(const std::string& control, const std::string& key)
+{
+    size_t start = 0;
+    while (start <= control.size())
+    {
+        size_t end = control.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = control.size();
+        }
+        std::string pair = control.substr(start, end - start);
+        if (pair.compare(0, key.size() + 1, key + "=") == 0)
+        {
+            return pair.substr(key.size() + 1);
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+// Decodes base64, false if it is not valid
+bool decode_base64(const std::string& b64, std::string& out)
+{
+    static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (b64.size() % 4 != 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < b64.size(); i += 4)
+    {
+        unsigned int bits = 0;
+        int padding = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            char c = b64[i + k];
+            size_t value = alphabet.find(c);
+            if (c == '=' && i + 4 == b64.size() && k >= 2)
+            {
+                padding++;
+                value = 0;
+            }
+            else if (value == std::string::npos || padding > 0)
+            {
+                return false;
+            }
+            bits = (bits << 6) | static_cast<unsigned int>(value);
+        }
+        out.push_back(static_cast<char>(bits >> 16));
+        if (padding < 2)
+        {
+            out.push_back(static_cast<char>((bits >> 8) & 0xFF));
+        }
+        if (padding < 1)
+        {
+            out.push_back(static_cast<char>(bits & 0xFF));
+        }
+    }
+    return true;
+}
+
+// Checks the chunking of one Kitty image made of chunks and returns the bytes
+// it carries
+void reassemble_kitty(const std::vector<KittyChunk>& chunks, std::string& data)
+{
+    ASSERT_FALSE(chunks.empty());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        bool last = (i + 1 == chunks.size());
+
+        // Only the first chunk has the control data, the others only m
+        if (i > 0)
+        {
+            EXPECT_EQ(last ? "m=0" : "m=1", chunks[i].control) << "chunk " << i;
+        }
+        EXPECT_EQ(last ? "0" : "1", control_value(chunks[i].control, "m")) << "chunk " << i;
+
+        // Chunks but the last are full, so that only the last one is padded
+        if (last)
+        {
+            EXPECT_LE(chunks[i].payload.size(), 4096u);
+        }
+        else
+        {
+            EXPECT_EQ(4096u, chunks[i].payload.size()) << "chunk " << i;
+        }
+        ASSERT_TRUE(decode_base64(chunks[i].payload, data)) << "chunk " << i;
+    }
+}
+
+// Sixel image decoded into palette registers, with the number of times each
+// pixel was painted
+struct SixelImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<int> registers;
+    std::vector<int> paint_count;
+    std::vector<bool> defined;
+};
+
+// Decodes the one sixel image in data
+void parse_sixel(const std::string& data, SixelImage& image)
+{
+    size_t start = data.find("\033P0;1q\"1;1;");
+    ASSERT_NE(std::string::npos, start);
+    size_t end = data.find("\033\\", start);
+    ASSERT_NE(std::string::npos, end);
+
+    const char* p = data.c_str() + start + 11;
+    const char* stop = data.c_str() + end;
+    image.width = static_cast<int>(strtol(p, const_cast<char**>(&p), 10));
+    ASSERT_EQ(';', *p++);
+    image.height = static_cast<int>(strtol(p, const_cast<char**>(&p), 10));
+    ASSERT_GT(image.width, 0);
+    ASSERT_GT(image.height, 0);
+
+    size_t num_pixels = static_cast<size_t>(image.width) * image.height;
+    image.registers.assign(num_pixels, -1);
+    image.paint_count.assign(num_pixels, 0);
+    image.defined.assign(256, false);
+
+    int x = 0;
+    int band = 0;
+    int color = -1;
+    while (p < stop)
+    {
+        char c = *p++;
+        if (c == '#')
+        {
+            color = static_cast<int>(strtol(p, const_cast<char**>(&p), 10));
+            ASSERT_GE(color, 0);
+            ASSERT_LT(color, 256);
+            if (*p == ';')
+            {
+                // Color definition, RGB in percentages
+                ASSERT_EQ(std::string(";2;"), std::string(p, 3));
+                p += 3;
+                for (int k = 0; k < 3; k++)
+                {
+                    long percent = strtol(p, const_cast<char**>(&p), 10);
+                    ASSERT_GE(percent, 0);
+                    ASSERT_LE(percent, 100);
+                    if (k < 2)
+                    {
+                        ASSERT_EQ(';', *p++);
+                    }
+                }
+                image.defined[color] = true;
+            }
+        }
+        else if (c == '$')
+        {
+            x = 0;
+        }
+        else if (c == '-')
+        {
+            x = 0;
+            band++;
+        }
+        else
+        {
+            int count = 1;
+            if (c == '!')
+            {
+                count = static_cast<int>(strtol(p, const_cast<char**>(&p), 10));
+                ASSERT_GT(count, 3) << "short runs are cheaper without !";
+                c = *p++;
+            }
+            ASSERT_GE(c, '?');
+            ASSERT_LE(c, '~');
+            ASSERT_GE(color, 0) << "sixel before any color";
+            ASSERT_TRUE(image.defined[color]) << "register " << color << " used before it is defined";
+
+            int bits = c - '?';
+            for (int k = 0; k < count; k++, x++)
+            {
+                for (int r = 0; r < 6; r++)
+                {
+                    if (!(bits & (1 << r)))
+                    {
+                        continue;
+                    }
+                    int y = band * 6 + r;
+                    ASSERT_LT(x, image.width);
+                    ASSERT_LT(y, image.height);
+                    size_t i = static_cast<size_t>(y) * image.width + x;
+                    image.registers[i] = color;
+                    image.paint_count[i]++;
+                }
+            }
+        }
+    }
+
+    // No new band after the last one, which could scroll the screen
+    EXPECT_EQ((image.height + 5) / 6 - 1, band);
+}
+
+// Checks that every pixel was painted once with the palette color of rgb
+void expect_sixel_pixels(const SixelImage& image, const std::vector<unsigned char>& rgb)
+{
+    size_t unpainted = 0;
+    size_t overpainted = 0;
+    size_t wrong_color = 0;
+    for (size_t i = 0; i < image.paint_count.size(); i++)
+    {
+        unpainted += (image.paint_count[i] == 0);
+        overpainted += (image.paint_count[i] > 1);
+        wrong_color += (image.registers[i] != Palette::rgb_to_256(&rgb[3 * i]));
+    }
+    EXPECT_EQ(0u, unpainted);
+    EXPECT_EQ(0u, overpainted);
+    EXPECT_EQ(0u, wrong_color);
+}
+
+// width x height RGB pixels, in flat stripes so that sixel has runs to
+// compress, with noise in the middle rows
+std::vector<unsigned char> test_pixels(const int& width, const int& height)
+{
+    std::mt19937 rng(width * 1000 + height);
+    std::uniform_int_distribution<int> value(0, 255);
+
+    std::vector<unsigned char> rgb(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char* pixel = &rgb[(static_cast<size_t>(y) * width + x) * 3];
+            bool noise = (y > height / 3 && y < height / 2);
+            pixel[0] = noise ? value(rng) : static_cast<unsigned char>((x / 8) * 40);
+            pixel[1] = noise ? value(rng) : static_cast<unsigned char>(y * 255 / height);
+            pixel[2] = noise ? value(rng) : 128;
+        }
+    }
+    return rgb;
+}
+
+// Same pixels as rgb in a BGR image
+cv::Mat to_bgr(const std::vector<unsigned char>& rgb, const int& width, const int& height)
+{
+    cv::Mat im(height, width, CV_8UC3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char* pixel = &rgb[(static_cast<size_t>(y) * width + x) * 3];
+            cv::Vec3b& bgr = im.at<cv::Vec3b>(y, x);
+            bgr[0] = pixel[2];
+            bgr[1] = pixel[1];
+            bgr[2] = pixel[0];
+        }
+    }
+    return im;
+}
+
+// Sets or unsets the variables the protocol is detected from, and puts them
+// back afterwards
+class DetectEnvironment : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        for (int i = 0; i < num_names_; i++)
+        {
+            const char* value = std::getenv(names_[i]);
+            saved_[i] = value ? value : "";
+            was_set_[i] = (value != NULL);
+            unsetenv(names_[i]);
+        }
+    }
+
+    void TearDown()
+    {
+        for (int i = 0; i < num_names_; i++)
+        {
+            if (was_set_[i])
+            {
+                setenv(names_[i], saved_[i].c_str(), 1);
+            }
+            else
+            {
+                unsetenv(names_[i]);
+            }
+        }
+    }
+
+    // Only the variables given are set, with TERM set to term
+    ImageProtocol detect_with(const char* term, const char* name = NULL, const char* value = "1")
+    {
+        for (int i = 0; i < num_names_; i++)
+        {
+            unsetenv(names_[i]);
+        }
+        if (term)
+        {
+            setenv("TERM", term, 1);
+        }
+        if (name)
+        {
+            setenv(name, value, 1);
+        }
+        return ImageProtocolEncoder::detect();
+    }
+
+    static const int num_names_ = 5;
+    const char* names_[num_names_] = {"TERM", "TERM_PROGRAM", "TMUX", "STY", "KITTY_WINDOW_ID"};
+    std::string saved_[num_names_];
+    bool was_set_[num_names_];
+};
+
+}  // namespace
+
+TEST(Kitty, ChunksReassembleToThePixels)
+{
+    // One pixel pads twice, 2x1 not at all, 37x29 spans two chunks and
+    // 64x64 fills four exactly
+    int sizes[][2] = {{1, 1}, {2, 1}, {5, 1}, {37, 29}, {64, 64}, {101, 77}};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        std::vector<unsigned char> rgb = test_pixels(width, height);
+
+        std::vector<char> out;
+        ImageProtocolEncoder::encode_kitty(rgb.data(), width, height, 12, 5, 3, out);
+
+        std::vector<KittyChunk> chunks;
+        ASSERT_TRUE(parse_kitty(std::string(out.begin(), out.end()), chunks));
+        EXPECT_EQ((rgb.size() + 3071) / 3072, chunks.size()) << width << "x" << height;
+
+        const std::string& control = chunks[0].control;
+        EXPECT_EQ("T", control_value(control, "a"));
+        EXPECT_EQ("24", control_value(control, "f"));
+        EXPECT_EQ(std::to_string(width), control_value(control, "s"));
+        EXPECT_EQ(std::to_string(height), control_value(control, "v"));
+        EXPECT_EQ("12", control_value(control, "c"));
+        EXPECT_EQ("5", control_value(control, "r"));
+        EXPECT_EQ("3", control_value(control, "i"));
+        EXPECT_EQ("1", control_value(control, "C"));
+        EXPECT_EQ("2", control_value(control, "q"));
+
+        std::string data;
+        reassemble_kitty(chunks, data);
+        EXPECT_TRUE(data == std::string(rgb.begin(), rgb.end())) << width << "x" << height;
+    }
+}
+
+TEST(Kitty, PngIsSentAsItIs)
+{
+    std::vector<unsigned char> png(10000);
+    for (size_t i = 0; i < png.size(); i++)
+    {
+        png[i] = static_cast<unsigned char>(i * 7 + i / 256);
+    }
+
+    std::vector<char> out;
+    ImageProtocolEncoder::encode_kitty_png(png, 4, 2, 1, out);
+
+    std::vector<KittyChunk> chunks;
+    ASSERT_TRUE(parse_kitty(std::string(out.begin(), out.end()), chunks));
+    ASSERT_EQ(4u, chunks.size());
+    EXPECT_EQ("100", control_value(chunks[0].control, "f"));
+    EXPECT_EQ("", control_value(chunks[0].control, "s"));
+
+    std::string data;
+    reassemble_kitty(chunks, data);
+    EXPECT_TRUE(data == std::string(png.begin(), png.end()));
+}
+
+TEST(Kitty, Delete)
+{
+    std::vector<char> out;
+    ImageProtocolEncoder::encode_kitty_delete(42, out);
+    EXPECT_EQ("\033_Ga=d,d=I,q=2,i=42\033\\", std::string(out.begin(), out.end()));
+}
+
+// The frame carries the pixels of the image, each id once
+TEST(Kitty, Frame)
+{
+    auto sink = std::make_shared<MemorySink>();
+    RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(20, 6));
+    rg.set_image_protocol(IMAGE_PROTOCOL_KITTY);
+    rg.clear_buffer();
+
+    // Smaller than the cells in pixels, so it is sent as it is
+    std::vector<unsigned char> rgb = test_pixels(40, 24);
+    rg.add_image(to_bgr(rgb, 40, 24), false);
+    rg.draw();
+
+    std::vector<KittyChunk> chunks;
+    ASSERT_TRUE(parse_kitty(sink->get_frame(0), chunks));
+    ASSERT_FALSE(chunks.empty());
+    EXPECT_EQ("1", control_value(chunks[0].control, "i"));
+    EXPECT_EQ("20", control_value(chunks[0].control, "c"));
+    EXPECT_EQ("6", control_value(chunks[0].control, "r"));
+
+    std::string data;
+    reassemble_kitty(chunks, data);
+    EXPECT_TRUE(data == std::string(rgb.begin(), rgb.end()));
+}
+
+TEST(Sixel, PaintsEveryPixelOnce)
+{
+    // Heights that are and are not a multiple of the 6 rows of a band
+    int sizes[][2] = {{1, 1}, {7, 6}, {33, 13}, {120, 50}};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        std::vector<unsigned char> rgb = test_pixels(width, height);
+
+        std::vector<char> out;
+        ImageProtocolEncoder::encode_sixel(rgb.data(), width, height, out);
+        std::string data(out.begin(), out.end());
+
+        SixelImage image;
+        parse_sixel(data, image);
+        ASSERT_FALSE(HasFatalFailure()) << width << "x" << height;
+        EXPECT_EQ(width, image.width);
+        EXPECT_EQ(height, image.height);
+        expect_sixel_pixels(image, rgb);
+        EXPECT_EQ(0u, data.find("\033P")) << "nothing before the image";
+        EXPECT_EQ(data.size() - 2, data.find("\033\\")) << "nothing after the image";
+    }
+}
+
+TEST(Sixel, CompressesRuns)
+{
+    // One color, so one run per band
+    std::vector<unsigned char> rgb(200 * 12 * 3, 200);
+    std::vector<char> out;
+    ImageProtocolEncoder::encode_sixel(rgb.data(), 200, 12, out);
+    std::string data(out.begin(), out.end());
+
+    EXPECT_NE(std::string::npos, data.find("!200~-"));
+    SixelImage image;
+    parse_sixel(data, image);
+    ASSERT_FALSE(HasFatalFailure());
+    expect_sixel_pixels(image, rgb);
+}
+
+// The frame carries the pixels of the image, kept off the last row
+TEST(Sixel, Frame)
+{
+    auto sink = std::make_shared<MemorySink>();
+    RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(20, 7));
+    rg.set_image_protocol(IMAGE_PROTOCOL_SIXEL);
+    rg.clear_buffer();
+
+    // 20x6 cells of 10x20 pixels, so it is sent as it is
+    std::vector<unsigned char> rgb = test_pixels(200, 120);
+    rg.add_image(to_bgr(rgb, 200, 120), false);
+    rg.draw();
+
+    SixelImage image;
+    parse_sixel(sink->get_frame(0), image);
+    ASSERT_FALSE(HasFatalFailure());
+    EXPECT_EQ(200, image.width);
+    EXPECT_EQ(120, image.height);
+    expect_sixel_pixels(image, rgb);
+}
+
+TEST_F(DetectEnvironment, MultiplexersFallBackToCells)
+{
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("xterm-kitty", "TMUX", "/tmp/tmux-1000/default,1,0"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("foot", "STY", "1234.pts-0.host"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("screen-256color", "KITTY_WINDOW_ID"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("tmux-256color", "TERM_PROGRAM", "WezTerm"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("screen"));
+}
+
+TEST_F(DetectEnvironment, Terminals)
+{
+    EXPECT_EQ(IMAGE_PROTOCOL_KITTY, detect_with("xterm-kitty"));
+    EXPECT_EQ(IMAGE_PROTOCOL_KITTY, detect_with("xterm-256color", "KITTY_WINDOW_ID"));
+    EXPECT_EQ(IMAGE_PROTOCOL_KITTY, detect_with("xterm-ghostty"));
+    EXPECT_EQ(IMAGE_PROTOCOL_SIXEL, detect_with("foot"));
+    EXPECT_EQ(IMAGE_PROTOCOL_SIXEL, detect_with("mlterm"));
+    EXPECT_EQ(IMAGE_PROTOCOL_SIXEL, detect_with("xterm-256color", "TERM_PROGRAM", "WezTerm"));
+    EXPECT_EQ(IMAGE_PROTOCOL_SIXEL, detect_with("xterm-256color", "TERM_PROGRAM", "iTerm.app"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with("xterm-256color"));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, detect_with(NULL));
+}
+
+TEST_F(DetectEnvironment, Parse)
+{
+    ImageProtocol protocol = IMAGE_PROTOCOL_CELLS;
+    EXPECT_TRUE(ImageProtocolEncoder::parse("sixel", protocol));
+    EXPECT_EQ(IMAGE_PROTOCOL_SIXEL, protocol);
+    EXPECT_TRUE(ImageProtocolEncoder::parse("kitty_png", protocol));
+    EXPECT_EQ(IMAGE_PROTOCOL_KITTY_PNG, protocol);
+
+    detect_with("xterm-kitty", "TMUX", "/tmp/tmux-1000/default,1,0");
+    EXPECT_TRUE(ImageProtocolEncoder::parse("auto", protocol));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, protocol);
+
+    EXPECT_FALSE(ImageProtocolEncoder::parse("iterm", protocol));
+    EXPECT_EQ(IMAGE_PROTOCOL_CELLS, protocol);
+}
@@ -0,0 +1,137 @@
+#include <roshell_graphics/mailbox.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace roshell_graphics;
+
+/**
+ * Checks that the mailbox keeps the newest item, counts the ones it drops and
+ * wakes up a waiting consumer
+*/
+
+namespace
+{
+
+typedef std::shared_ptr<int> Item;
+
+// Gives the consumer thread time to go to sleep
+void wait_a_bit()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+}  // namespace
+
+TEST(Mailbox, KeepsTheNewestItem)
+{
+    Mailbox<Item> mailbox;
+    Item first = std::make_shared<int>(1);
+    std::weak_ptr<int> first_ref = first;
+
+    EXPECT_FALSE(mailbox.put(first));
+    first.reset();
+    EXPECT_TRUE(mailbox.put(std::make_shared<int>(2)));
+    EXPECT_EQ(1u, mailbox.get_dropped());
+
+    // The dropped item is released, not kept in a slot
+    EXPECT_TRUE(first_ref.expired());
+
+    Item taken;
+    ASSERT_TRUE(mailbox.take(taken));
+    ASSERT_TRUE(taken != NULL);
+    EXPECT_EQ(2, *taken);
+
+    // Taking empties the slot, so the next put drops nothing
+    EXPECT_FALSE(mailbox.put(std::make_shared<int>(3)));
+    EXPECT_TRUE(mailbox.put(std::make_shared<int>(4)));
+    EXPECT_TRUE(mailbox.put(std::make_shared<int>(5)));
+    EXPECT_EQ(3u, mailbox.get_dropped());
+    ASSERT_TRUE(mailbox.take(taken));
+    EXPECT_EQ(5, *taken);
+}
+
+TEST(Mailbox, TakeWaitsForPut)
+{
+    Mailbox<Item> mailbox;
+    Item taken;
+    bool result = false;
+    std::thread consumer([&]() { result = mailbox.take(taken); });
+
+    wait_a_bit();
+    mailbox.put(std::make_shared<int>(7));
+    consumer.join();
+
+    EXPECT_TRUE(result);
+    ASSERT_TRUE(taken != NULL);
+    EXPECT_EQ(7, *taken);
+    EXPECT_EQ(0u, mailbox.get_dropped());
+}
+
+TEST(Mailbox, CloseWakesUpTake)
+{
+    Mailbox<Item> mailbox;
+    Item taken;
+    bool result = true;
+    std::thread consumer([&]() { result = mailbox.take(taken); });
+
+    wait_a_bit();
+    mailbox.close();
+    consumer.join();
+
+    EXPECT_FALSE(result);
+    EXPECT_TRUE(taken == NULL);
+}
+
+TEST(Mailbox, ItemPutBeforeCloseIsTaken)
+{
+    Mailbox<Item> mailbox;
+    mailbox.put(std::make_shared<int>(8));
+    mailbox.close();
+
+    Item taken;
+    ASSERT_TRUE(mailbox.take(taken));
+    EXPECT_EQ(8, *taken);
+    EXPECT_FALSE(mailbox.take(taken));
+}
+
+// A fast producer and a slow consumer: the consumer sees increasing items,
+// ends with the last one, and every item is either taken or dropped
+TEST(Mailbox, ProducerAndConsumer)
+{
+    const int num_items = 200000;
+    Mailbox<Item> mailbox;
+    std::vector<int> seen;
+
+    std::thread consumer([&]()
+    {
+        Item taken;
+        while (mailbox.take(taken))
+        {
+            seen.push_back(*taken);
+        }
+    });
+
+    for (int i = 1; i <= num_items; i++)
+    {
+        mailbox.put(std::make_shared<int>(i));
+        if (i % 1000 == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    mailbox.close();
+    consumer.join();
+
+    ASSERT_FALSE(seen.empty());
+    for (size_t i = 1; i < seen.size(); i++)
+    {
+        ASSERT_LT(seen[i - 1], seen[i]) << "item " << i;
+    }
+    EXPECT_EQ(num_items, seen.back());
+    EXPECT_EQ(static_cast<uint64_t>(num_items), seen.size() + mailbox.get_dropped());
+}
@@ -0,0 +1,80 @@
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+
+using namespace roshell_graphics;
+
+/**
+ * Bins the same clouds on one thread and on several, whose histograms are
+ * merged afterwards, and checks that the frames are the same
+*/
+
+namespace
+{
+
+// Enough points for every thread to get a share, and not a multiple of any
+// of the thread counts, so the last share is shorter
+const size_t num_points = 70001;
+
+// A dense cloud in natural frame with z in [-10, 10], so that the cells are
+// hit by points of several threads with different colors
+Eigen::Matrix3Xf random_cloud(const size_t& n, const int& seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x(-40.0f, 39.9f);
+    std::uniform_real_distribution<float> y(-11.9f, 12.0f);
+    std::uniform_real_distribution<float> z(-10.0f, 10.0f);
+
+    Eigen::Matrix3Xf points(3, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        points(0, i) = x(rng);
+        points(1, i) = y(rng);
+        points(2, i) = z(rng);
+    }
+    return points;
+}
+
+// Draws with num_threads threads and returns the frame
+template <typename Draw>
+std::string draw_frame(const RasterMode& raster_mode, const int& num_threads, const Draw& draw)
+{
+    auto sink = std::make_shared<MemorySink>();
+    RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(80, 24));
+    rg.set_color_depth(COLOR_DEPTH_TRUECOLOR);
+    rg.set_raster_mode(raster_mode);
+    rg.set_num_threads(num_threads);
+    rg.clear_buffer();
+    draw(rg);
+    rg.draw();
+    return sink->get_frame(0);
+}
+
+}  // namespace
+
+TEST(ParallelBinning, SameFrameAsOneThread)
+{
+    Eigen::Matrix3Xf colored = random_cloud(num_points, 1);
+    Eigen::Matrix2Xf plain = random_cloud(num_points, 2).topRows(2);
+    RasterMode modes[2] = {RASTER_MODE_DENSITY, RASTER_MODE_BRAILLE};
+    int thread_counts[2] = {2, 8};
+
+    for (int m = 0; m < 2; m++)
+    {
+        auto draw = [&](RoshellGraphics& rg)
+        {
+            rg.add_points(colored);
+            rg.add_points(plain);
+        };
+        std::string expected = draw_frame(modes[m], 1, draw);
+
+        for (int t = 0; t < 2; t++)
+        {
+            EXPECT_TRUE(draw_frame(modes[m], thread_counts[t], draw) == expected)
+                << "mode " << m << ", " << thread_counts[t] << " threads";
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace roshell_graphics;
+
+/**
+ * Draws the same frames with one thread and with several, which encode large
+ * frames in bands of rows, and checks that the bytes sent are the same
+*/
+
+namespace
+{
+
+struct Scene
+{
+    int width;
+    int height;
+    ColorDepth color_depth;
+    bool dithering;
+};
+
+// Draws a sequence of frames: full redraws, frames where little changes,
+// including cells on both sides of where the bands meet, an unchanged frame
+// and a resize. Returns every frame sent.
+std::vector<std::string> draw_frames(const Scene& scene, const int& num_threads)
+{
+    auto sink = std::make_shared<MemorySink>();
+    auto size = std::make_shared<FixedSizeProvider>(scene.width, scene.height);
+    RoshellGraphics rg(sink, size);
+    rg.set_color_depth(scene.color_depth);
+    rg.set_dithering(scene.dithering);
+    rg.set_num_threads(num_threads);
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> coordinate(-200.0f, 200.0f);
+    Eigen::Matrix3Xf points(3, 20000);
+    for (int i = 0; i < points.cols(); i++)
+    {
+        points(0, i) = coordinate(rng);
+        points(1, i) = coordinate(rng) / 3;
+        points(2, i) = coordinate(rng);
+    }
+
+    cv::Mat im(150, 200, CV_8UC3);
+    for (int r = 0; r < im.rows; r++)
+    {
+        for (int c = 0; c < im.cols; c++)
+        {
+            cv::Vec3b& pixel = im.at<cv::Vec3b>(r, c);
+            pixel[0] = static_cast<unsigned char>(r * 5);
+            pixel[1] = static_cast<unsigned char>(c * 3);
+            pixel[2] = static_cast<unsigned char>((r + c) * 2);
+        }
+    }
+
+    // One color, so that bands start with the background the one before
+    // them ends with
+    cv::Mat flat(150, 200, CV_8UC3);
+    for (int r = 0; r < flat.rows; r++)
+    {
+        for (int c = 0; c < flat.cols; c++)
+        {
+            cv::Vec3b& pixel = flat.at<cv::Vec3b>(r, c);
+            pixel[0] = 90;
+            pixel[1] = 160;
+            pixel[2] = 40;
+        }
+    }
+
+    std::vector<unsigned char> red = {200, 30, 30};
+    std::vector<unsigned char> blue = {30, 30, 200};
+
+    for (int f = 0; f < 12; f++)
+    {
+        if (f == 9)
+        {
+            size->set_size(scene.width / 2 + 3, scene.height + 5);
+        }
+        rg.clear_buffer();
+        rg.set_raster_mode(f % 4 == 1 ? RASTER_MODE_BRAILLE : RASTER_MODE_DENSITY);
+        rg.set_image_mode(f % 2 ? IMAGE_MODE_HALF_BLOCK : IMAGE_MODE_FULL_BLOCK);
+
+        switch (f)
+        {
+        case 0:
+        case 9:
+            rg.add_image(im, false);
+            break;
+        case 1:
+        case 2:
+            rg.add_points(points);
+            break;
+        case 10:
+            rg.add_image(im, true);
+            break;
+        case 11:
+            rg.add_image(flat, false);
+            break;
+        }
+        rg.add_natural_frame();
+        rg.add_line(Point(-150, -40), Point(150, 40), "#");
+
+        // The first column and the last one in runs of 7 rows of the same
+        // color, so that bands often start with the color the one before
+        // them ends with. The runs move down every frame but frame 4,
+        // which is the same as frame 3.
+        std::pair<int, int> terminal_size = rg.get_terminal_size();
+        int shift = (f == 4) ? 3 : f;
+        for (int y = 0; y < terminal_size.second; y++)
+        {
+            const std::vector<unsigned char>& color = ((y + shift) / 7) % 2 ? red : blue;
+            rg.fill_buffer(Point(0, y), color, "@");
+            rg.fill_buffer(Point(terminal_size.first - 1, y), color, "@");
+        }
+        if (f == 5)
+        {
+            rg.add_text(Point(-3, 0), "bands");
+        }
+        if (f == 7)
+        {
+            rg.force_redraw();
+        }
+        rg.draw();
+    }
+
+    std::vector<std::string> frames;
+    for (size_t i = 0; i < sink->get_num_frames(); i++)
+    {
+        frames.push_back(sink->get_frame(i));
+    }
+    return frames;
+}
+
+}  // namespace
+
+TEST(ParallelEncoding, SameBytesAsOneThread)
+{
+    // Bands take at least 8192 cells, so 80x24 and 128x127 are encoded in
+    // one, 128x128 in two and 400x120 in one per thread
+    int sizes[][2] = {{80, 24}, {128, 127}, {128, 128}, {400, 120}};
+    ColorDepth color_depths[] = {COLOR_DEPTH_TRUECOLOR, COLOR_DEPTH_256, COLOR_DEPTH_16};
+    int thread_counts[] = {2, 3, 4, 7};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        for (size_t d = 0; d < sizeof(color_depths) / sizeof(color_depths[0]); d++)
+        {
+            for (int dithering = 0; dithering < 2; dithering++)
+            {
+                // Dithering only applies below truecolor
+                if (dithering && color_depths[d] == COLOR_DEPTH_TRUECOLOR)
+                {
+                    continue;
+                }
+
+                Scene scene = {sizes[s][0], sizes[s][1], color_depths[d], dithering == 1};
+                std::vector<std::string> expected = draw_frames(scene, 1);
+
+                for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++)
+                {
+                    std::stringstream trace;
+                    trace << scene.width << "x" << scene.height << ", color depth " << scene.color_depth
+                        << ", dithering " << scene.dithering << ", " << thread_counts[t] << " threads";
+                    SCOPED_TRACE(trace.str());
+
+                    std::vector<std::string> frames = draw_frames(scene, thread_counts[t]);
+                    ASSERT_EQ(expected.size(), frames.size());
+                    for (size_t i = 0; i < frames.size(); i++)
+                    {
+                        EXPECT_TRUE(frames[i] == expected[i]) << "frame " << i << " differs, "
+                            << frames[i].size() << " bytes instead of " << expected[i].size();
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,326 @@
+#include <roshell_graphics/point_binning.h>
+#include <roshell_graphics/roshell_graphics.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace roshell_graphics;
+
+/**
+ * Runs the kernels of every SimdLevel the CPU supports on the same points and
+ * checks that they give the same results as the scalar ones
+*/
+
+namespace
+{
+
+// Point counts that leave tails after blocks of 4 and 8, and span several
+// POINT_BLOCK_SIZE blocks
+const size_t counts[] = {0, 1, 3, 5, 7, 9, 13, 15, 17, 31, 33, 1000, 1027, 2 * POINT_BLOCK_SIZE + 11};
+
+// Points with x, y and z in [-range, range], padded to stride floats, with
+// some of them NaN, infinite or at the edges of the grid
+std::vector<float> random_points(const size_t& n, const size_t& stride, const float& range, const int& seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> value(-range, range);
+    std::uniform_int_distribution<int> special(0, 15);
+
+    std::vector<float> points(n * stride, 0.0f);
+    for (size_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            float v = value(rng);
+            switch (special(rng))
+            {
+            case 0:
+                v = std::numeric_limits<float>::quiet_NaN();
+                break;
+            case 1:
+                v = std::numeric_limits<float>::infinity();
+                break;
+            case 2:
+                v = -std::numeric_limits<float>::infinity();
+                break;
+            case 3:
+                v = std::floor(v);
+                break;
+            case 4:
+                v = 1e9f;
+                break;
+            }
+            points[i * stride + k] = v;
+        }
+    }
+    return points;
+}
+
+// Equal bit for bit, or both NaN since the sign of NaNs may differ
+bool same_float(const float& a, const float& b)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        return std::isnan(a) && std::isnan(b);
+    }
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+class PointBinning : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        initial_level_ = PointBinner::get_simd_level();
+        for (int level = SIMD_LEVEL_SCALAR; level <= PointBinner::get_max_simd_level(); level++)
+        {
+            levels_.push_back(static_cast<SimdLevel>(level));
+        }
+        if (levels_.size() < 2)
+        {
+            std::cout << "Only the scalar kernels are supported, nothing to compare them with" << std::endl;
+        }
+    }
+
+    void TearDown()
+    {
+        PointBinner::set_simd_level(initial_level_);
+    }
+
+    std::vector<SimdLevel> levels_;
+    SimdLevel initial_level_;
+};
+
+}  // namespace
+
+TEST_F(PointBinning, Bin)
+{
+    // Density cells, and Braille cells of 2x4 dots
+    BinningGrid grids[2] = {
+        {1.0f, 40.5f, -1.0f, 12.5f, 80, 24, 0, 0},
+        {2.0f, 80.0f, -4.0f, 48.0f, 160, 96, 1, 2}};
+
+    for (int g = 0; g < 2; g++)
+    {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        {
+            for (size_t stride = 3; stride <= 4; stride++)
+            {
+                size_t n = counts[c];
+                std::vector<float> points = random_points(n, stride, 60.0f, static_cast<int>(n + stride));
+
+                std::vector<int32_t> expected(n);
+                ASSERT_TRUE(PointBinner::set_simd_level(SIMD_LEVEL_SCALAR));
+                PointBinner::bin(grids[g], points.data(), points.data() + 1, stride, n, expected.data());
+
+                for (size_t l = 1; l < levels_.size(); l++)
+                {
+                    ASSERT_TRUE(PointBinner::set_simd_level(levels_[l]));
+                    std::vector<int32_t> bins(n, 0);
+                    PointBinner::bin(grids[g], points.data(), points.data() + 1, stride, n, bins.data());
+                    EXPECT_TRUE(bins == expected) << PointBinner::get_simd_level_name(levels_[l])
+                        << " bins differ, grid " << g << ", " << n << " points, stride " << stride;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PointBinning, ColorAndRange)
+{
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        size_t n = counts[c];
+        std::vector<float> points = random_points(n, 3, 10.0f, static_cast<int>(n));
+
+        std::vector<unsigned char> expected(n);
+        float expected_min = 0.0f;
+        float expected_max = 0.0f;
+        ASSERT_TRUE(PointBinner::set_simd_level(SIMD_LEVEL_SCALAR));
+        PointBinner::color(points.data() + 2, 3, n, 12.75f, 128, expected.data());
+        bool expected_found = PointBinner::range(points.data() + 2, 3, n, expected_min, expected_max);
+
+        for (size_t l = 1; l < levels_.size(); l++)
+        {
+            ASSERT_TRUE(PointBinner::set_simd_level(levels_[l]));
+            const char* name = PointBinner::get_simd_level_name(levels_[l]);
+
+            std::vector<unsigned char> colormap_idx(n, 0);
+            PointBinner::color(points.data() + 2, 3, n, 12.75f, 128, colormap_idx.data());
+            EXPECT_TRUE(colormap_idx == expected) << name << " colors differ, " << n << " points";
+
+            float min_v = 0.0f;
+            float max_v = 0.0f;
+            bool found = PointBinner::range(points.data() + 2, 3, n, min_v, max_v);
+            EXPECT_EQ(expected_found, found) << name << ", " << n << " points";
+            if (found && expected_found)
+            {
+                EXPECT_TRUE(same_float(expected_min, min_v)) << name << ", " << n << " points";
+                EXPECT_TRUE(same_float(expected_max, max_v)) << name << ", " << n << " points";
+            }
+        }
+    }
+}
+
+TEST_F(PointBinning, Merge)
+{
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> value(0, UINT16_MAX);
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        for (int use_depth = 0; use_depth < 2; use_depth++)
+        {
+            size_t n = counts[c];
+
+            // Half of the cells of each histogram empty, with no color
+            std::vector<uint16_t> count(n), other_count(n), color(n), other_color(n);
+            std::vector<unsigned char> dots(n), other_dots(n);
+            std::vector<float> depth(n), other_depth(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                count[i] = value(rng);
+                other_count[i] = value(rng);
+                dots[i] = value(rng) & 0xFF;
+                other_dots[i] = value(rng) & 0xFF;
+                color[i] = (value(rng) & 1) ? value(rng) & 0xFF : 0;
+                other_color[i] = (value(rng) & 1) ? value(rng) & 0xFF : 0;
+                depth[i] = color[i] ? value(rng) * 0.01f : std::numeric_limits<float>::infinity();
+                other_depth[i] = other_color[i] ? value(rng) * 0.01f : std::numeric_limits<float>::infinity();
+            }
+
+            std::vector<uint16_t> expected_count = count, expected_color = color;
+            std::vector<unsigned char> expected_dots = dots;
+            std::vector<float> expected_depth = depth;
+            ASSERT_TRUE(PointBinner::set_simd_level(SIMD_LEVEL_SCALAR));
+            PointBinner::merge(expected_count.data(), expected_dots.data(), expected_color.data(),
+                use_depth ? expected_depth.data() : NULL, other_count.data(), other_dots.data(),
+                other_color.data(), other_depth.data(), n);
+
+            for (size_t l = 1; l < levels_.size(); l++)
+            {
+                ASSERT_TRUE(PointBinner::set_simd_level(levels_[l]));
+                std::vector<uint16_t> merged_count = count, merged_color = color;
+                std::vector<unsigned char> merged_dots = dots;
+                std::vector<float> merged_depth = depth;
+                PointBinner::merge(merged_count.data(), merged_dots.data(), merged_color.data(),
+                    use_depth ? merged_depth.data() : NULL, other_count.data(), other_dots.data(),
+                    other_color.data(), other_depth.data(), n);
+
+                const char* name = PointBinner::get_simd_level_name(levels_[l]);
+                EXPECT_TRUE(merged_count == expected_count) << name << " counts differ, " << n << " cells";
+                EXPECT_TRUE(merged_dots == expected_dots) << name << " dots differ, " << n << " cells";
+                EXPECT_TRUE(merged_color == expected_color) << name << " colors differ, " << n << " cells";
+                EXPECT_TRUE(merged_depth == expected_depth) << name << " depths differ, " << n << " cells";
+            }
+        }
+    }
+}
+
+TEST_F(PointBinning, Project)
+{
+    // Camera at (0, 0, -20) looking along z, turned a little so that no
+    // coefficient is 0 or 1, with about half of the points behind it
+    float angle = 0.3f;
+    ProjectionGrid grid = {
+        {{std::cos(angle), 0.0f, -std::sin(angle), 1.5f},
+         {0.1f, 0.99f, 0.05f, -2.0f},
+         {std::sin(angle), 0.0f, std::cos(angle), 0.25f}},
+        30.0f};
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        for (size_t stride = 3; stride <= 4; stride++)
+        {
+            size_t n = counts[c];
+            std::vector<float> points = random_points(n, stride, 50.0f, static_cast<int>(3 * n + stride));
+
+            std::vector<float> expected(4 * n);
+            ASSERT_TRUE(PointBinner::set_simd_level(SIMD_LEVEL_SCALAR));
+            PointBinner::project(grid, points.data(), stride, n, expected.data());
+
+            for (size_t l = 1; l < levels_.size(); l++)
+            {
+                ASSERT_TRUE(PointBinner::set_simd_level(levels_[l]));
+                std::vector<float> xyzd(4 * n, 0.0f);
+                PointBinner::project(grid, points.data(), stride, n, xyzd.data());
+
+                size_t mismatches = 0;
+                for (size_t i = 0; i < 4 * n; i++)
+                {
+                    if (!same_float(expected[i], xyzd[i]))
+                    {
+                        mismatches++;
+                    }
+                }
+                EXPECT_EQ(0u, mismatches) << PointBinner::get_simd_level_name(levels_[l])
+                    << " projections differ, " << n << " points, stride " << stride;
+            }
+        }
+    }
+}
+
+// Whole frames, with the histograms and colors drawn by every level. There
+// are enough points for them to be binned on several threads and merged.
+TEST_F(PointBinning, Frames)
+{
+    const size_t n = 50003;
+    std::vector<float> points = random_points(n, 3, 60.0f, 11);
+    RasterMode modes[2] = {RASTER_MODE_DENSITY, RASTER_MODE_BRAILLE};
+
+    for (int m = 0; m < 2; m++)
+    {
+        for (int depth_test = 0; depth_test < 2; depth_test++)
+        {
+            std::string expected;
+            for (size_t l = 0; l < levels_.size(); l++)
+            {
+                ASSERT_TRUE(PointBinner::set_simd_level(levels_[l]));
+
+                auto sink = std::make_shared<MemorySink>();
+                RoshellGraphics rg(sink, std::make_shared<FixedSizeProvider>(80, 24));
+                rg.set_color_depth(COLOR_DEPTH_TRUECOLOR);
+                rg.set_raster_mode(modes[m]);
+                rg.set_depth_test(depth_test);
+                rg.set_num_threads(3);
+                rg.clear_buffer();
+                if (depth_test)
+                {
+                    // Only points given with a depth go through the depth test
+                    rg.add_points([&points](const size_t& start, const size_t& len, float* xyzd)
+                    {
+                        for (size_t i = 0; i < len; i++)
+                        {
+                            const float* point = &points[3 * (start + i)];
+                            xyzd[4 * i] = point[0];
+                            xyzd[4 * i + 1] = point[1];
+                            xyzd[4 * i + 2] = point[2];
+                            xyzd[4 * i + 3] = std::fabs(point[0] - point[2]);
+                        }
+                    }, n, true, -10.0f, 10.0f);
+                }
+                else
+                {
+                    rg.add_points(points.data(), points.data() + 1, points.data() + 2, 3, n, -10.0f, 10.0f);
+                }
+                rg.draw();
+
+                if (l == 0)
+                {
+                    expected = sink->get_frame(0);
+                }
+                else
+                {
+                    EXPECT_TRUE(sink->get_frame(0) == expected) << PointBinner::get_simd_level_name(levels_[l])
+                        << " frame differs, mode " << m << ", depth test " << depth_test;
+                }
+            }
+        }
+    }
+}
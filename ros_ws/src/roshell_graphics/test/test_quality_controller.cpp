@@ -0,0 +1,166 @@
+#include <roshell_graphics/quality_controller.h>
+
+#include <gtest/gtest.h>
+
+using namespace roshell_graphics;
+
+/**
+ * Feeds synthetic frame times and sizes to the quality controller and checks
+ * when it changes level
+*/
+
+namespace
+{
+
+// 10 fps, so a frame has 100 ms, and about two seconds to recover
+const double target_fps = 10.0;
+const uint64_t budget_ns = 100000000;
+const int recover_frames = 20;
+
+// Frames ignored after a change, and over budget in a row before a drop
+const int settle_frames = 3;
+const int degrade_frames = 3;
+
+// Frame taking load times the budget
+uint64_t frame_ns(const double& load)
+{
+    return static_cast<uint64_t>(load * budget_ns);
+}
+
+// Feeds frames at load until the level changes, returns how many it took or
+// -1 if it did not change within max_frames
+int frames_until_change(QualityController& quality, const double& load, const int& max_frames)
+{
+    for (int i = 1; i <= max_frames; i++)
+    {
+        if (quality.update(frame_ns(load), 0))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+TEST(QualityController, SustainedOverloadStepsDown)
+{
+    QualityController quality(target_fps);
+    EXPECT_EQ(0, quality.get_level());
+
+    for (int level = 1; level < quality.get_num_levels(); level++)
+    {
+        EXPECT_EQ(settle_frames + degrade_frames, frames_until_change(quality, 2.0, 100)) << "level " << level;
+        EXPECT_EQ(level, quality.get_level());
+    }
+
+    // Nothing below the cheapest level
+    EXPECT_EQ(-1, frames_until_change(quality, 2.0, 100));
+    EXPECT_EQ(quality.get_num_levels() - 1, quality.get_level());
+}
+
+TEST(QualityController, BytesOverBudgetStepDown)
+{
+    // 100 KB per frame, frames that are fast but three times too big
+    QualityController quality(target_fps, 1000000.0);
+    int frames = 0;
+    while (!quality.update(frame_ns(0.1), 300000) && frames < 100)
+    {
+        frames++;
+    }
+    EXPECT_EQ(settle_frames + degrade_frames - 1, frames);
+    EXPECT_EQ(1, quality.get_level());
+    EXPECT_GT(quality.get_load(), 1.0);
+}
+
+TEST(QualityController, SingleSpikeDoesNotStepDown)
+{
+    QualityController quality(target_fps);
+    EXPECT_EQ(-1, frames_until_change(quality, 0.8, 30));
+
+    // However slow, one frame is not enough
+    double spikes[] = {1.5, 3.0, 20.0};
+    for (int s = 0; s < 3; s++)
+    {
+        EXPECT_FALSE(quality.update(frame_ns(spikes[s]), 0));
+        EXPECT_EQ(-1, frames_until_change(quality, 0.8, 30)) << "spike of " << spikes[s];
+        EXPECT_EQ(0, quality.get_level());
+    }
+
+    // Nor two in a row
+    EXPECT_FALSE(quality.update(frame_ns(3.0), 0));
+    EXPECT_FALSE(quality.update(frame_ns(3.0), 0));
+    EXPECT_EQ(-1, frames_until_change(quality, 0.8, 30));
+    EXPECT_EQ(0, quality.get_level());
+}
+
+TEST(QualityController, StepsUpAfterTheRecoveryWindow)
+{
+    QualityController quality(target_fps);
+    ASSERT_GT(frames_until_change(quality, 2.0, 100), 0);
+    ASSERT_GT(frames_until_change(quality, 2.0, 100), 0);
+    ASSERT_EQ(2, quality.get_level());
+
+    // Under budget but not by enough
+    EXPECT_EQ(-1, frames_until_change(quality, 0.6, 200));
+    EXPECT_EQ(2, quality.get_level());
+
+    // Well under budget. Coming from 0.6 the average only goes below 0.5 on
+    // the second frame, the next level first waits for its settling frames.
+    EXPECT_EQ(1 + recover_frames, frames_until_change(quality, 0.2, 200));
+    EXPECT_EQ(1, quality.get_level());
+    EXPECT_EQ(settle_frames + recover_frames, frames_until_change(quality, 0.2, 200));
+    EXPECT_EQ(0, quality.get_level());
+
+    // Nothing above full quality
+    EXPECT_EQ(-1, frames_until_change(quality, 0.2, 200));
+}
+
+TEST(QualityController, OscillationBacksOff)
+{
+    QualityController quality(target_fps);
+    ASSERT_GT(frames_until_change(quality, 2.0, 100), 0);
+    ASSERT_EQ(1, quality.get_level());
+
+    // Every upgrade undone right away doubles the wait for the next one, up
+    // to 8 times the first
+    int waits[] = {1, 2, 4, 8, 8};
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_EQ(settle_frames + waits[i] * recover_frames, frames_until_change(quality, 0.2, 1000))
+            << "upgrade " << i;
+        EXPECT_EQ(0, quality.get_level());
+        EXPECT_EQ(settle_frames + degrade_frames, frames_until_change(quality, 2.0, 100)) << "upgrade " << i;
+        EXPECT_EQ(1, quality.get_level());
+    }
+
+    // An upgrade that holds for the whole wait resets it
+    EXPECT_EQ(settle_frames + 8 * recover_frames, frames_until_change(quality, 0.2, 1000));
+    EXPECT_EQ(-1, frames_until_change(quality, 0.7, 8 * recover_frames + 1));
+    EXPECT_EQ(0, quality.get_level());
+
+    // No settling frames, the level has not changed for a while
+    EXPECT_EQ(degrade_frames, frames_until_change(quality, 2.0, 100));
+    EXPECT_EQ(settle_frames + recover_frames, frames_until_change(quality, 0.2, 1000));
+}
+
+TEST(QualityController, ImageLevelsOnlyChangeWhatImagesUse)
+{
+    const std::vector<QualityLevel>& levels = QualityController::get_image_levels();
+    ASSERT_GT(levels.size(), 1u);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        EXPECT_EQ(1, levels[i].subsampling) << "level " << i;
+        if (i > 0)
+        {
+            EXPECT_TRUE(levels[i].color_depth != levels[i - 1].color_depth ||
+                levels[i].low_resolution != levels[i - 1].low_resolution) << "level " << i;
+        }
+    }
+
+    // The first overload already gives up colors
+    QualityController quality(target_fps, 0.0, levels);
+    EXPECT_EQ(static_cast<int>(levels.size()), quality.get_num_levels());
+    ASSERT_GT(frames_until_change(quality, 2.0, 100), 0);
+    EXPECT_EQ(COLOR_DEPTH_256, quality.get_quality().color_depth);
+}